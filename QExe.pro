@@ -1,4 +1,5 @@
 QT -= gui
+QT += concurrent
 
 TEMPLATE = lib
 DEFINES += QEXE_LIBRARY
@@ -18,25 +19,68 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
     qexe.cpp \
+    qexecavefinder.cpp \
+    qexechecksum.cpp \
     qexecoffheader.cpp \
+    qexedelta.cpp \
     qexedosstub.cpp \
+    qexeexceptiontable.cpp \
+    qexeexporttable.cpp \
+    qexeimportbuilder.cpp \
+    qexeimporttable.cpp \
     qexeoptionalheader.cpp \
+    qexeoverlay.cpp \
+    qexepatchset.cpp \
+    qexereloctable.cpp \
+    qexersrcarena.cpp \
+    qexersrcdiff.cpp \
     qexersrcentry.cpp \
+    qexersrcicongroup.cpp \
     qexersrcmanager.cpp \
+    qexersrcquery.cpp \
+    qexersrcstringtable.cpp \
+    qexersrcversioninfo.cpp \
+    qexervaresolver.cpp \
+    qexervarewriter.cpp \
     qexesection.cpp \
-    qexesectionmanager.cpp
+    qexesectionmanager.cpp \
+    qexesignaturescanner.cpp \
+    qexevirtualimage.cpp
 
 HEADERS += \
     QExe_global.h \
     qexe.h \
+    qexecavefinder.h \
+    qexechecksum_p.h \
     qexecoffheader.h \
+    qexeconcurrent_p.h \
+    qexedelta.h \
     qexedosstub.h \
     qexeerrorinfo.h \
+    qexeexceptiontable.h \
+    qexeexporttable.h \
+    qexehash_p.h \
+    qexeimportbuilder.h \
+    qexeimporttable.h \
     qexeoptionalheader.h \
+    qexeoverlay.h \
+    qexepatchset.h \
+    qexereloctable.h \
+    qexersrcarena_p.h \
+    qexersrcdiff.h \
     qexersrcentry.h \
+    qexersrcicongroup.h \
     qexersrcmanager.h \
+    qexersrcquery.h \
+    qexersrcstringtable.h \
+    qexersrcversioninfo.h \
+    qexervaresolver.h \
+    qexervarewriter_p.h \
     qexesection.h \
     qexesectionmanager.h \
+    qexesignaturescanner.h \
+    qexevirtualimage.h \
+    qexeutf16_p.h \
     typedef_version.h
 
 # Default rules for deployment.
@@ -21,7 +21,11 @@ LIBS += -L$${QEXE_LIB_DIR} -lQExe
 INCLUDEPATH += $${QEXE_INCLUDE_DIR}
 
 SOURCES += \
-        main.cpp
+        main.cpp \
+        tests.cpp
+
+HEADERS += \
+        tests.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
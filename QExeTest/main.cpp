@@ -4,6 +4,7 @@
 #include <QMetaEnum>
 
 #include "qexe.h"
+#include "tests.h"
 
 #include <iostream>
 
@@ -98,7 +99,8 @@ void waitForEnter() {
 
 int main(int argc, char *argv[])
 {
-    (void)argc, (void)argv;
+    if (argc > 1 && QLatin1String(argv[1]) == "--tests")
+        return runTests() == 0 ? 0 : 1;
 
     QExe exeDat;
 
@@ -0,0 +1,431 @@
+#include "tests.h"
+
+#include <QBuffer>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtEndian>
+
+#include "qexe.h"
+#include "qexedelta.h"
+#include "qexepatchset.h"
+#include "qexersrcdiff.h"
+
+#define OUT qInfo().noquote().nospace()
+#define CHECK(cond) \
+    if (!(cond)) { \
+        OUT << "  check failed (line " << __LINE__ << "): " << #cond; \
+        return false; \
+    }
+
+// data directories have to be there before any section is added, since they're part of the header size
+static void addDataDirectories(QExe &exeDat)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    while (optHead->dataDirectories.size() < 16)
+        optHead->dataDirectories += DataDirectoryPtr(new DataDirectory(0, 0));
+}
+
+static QExeSectionPtr addSection(QExe &exeDat, const char *name, const QByteArray &data,
+                                 QExeSection::Characteristics chars = QExeSection::ContainsInitializedData | QExeSection::IsReadable)
+{
+    QExeSectionPtr section = exeDat.sectionManager()->createSection(QLatin1String(name), data, chars);
+    if (!section.isNull())
+        section->virtualSize = static_cast<quint32>(data.size());
+    return section;
+}
+
+static bool writeFile(QExe &exeDat, const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QFile::WriteOnly) && exeDat.write(file);
+}
+
+static bool readFile(QExe &exeDat, const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QFile::ReadOnly) && exeDat.read(file);
+}
+
+static QByteArray fileData(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+// the last section's raw data doesn't end on the file alignment, so write() pads it before the overlay
+static bool testOverlayInPlace()
+{
+    QTemporaryDir dir;
+    CHECK(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("overlay.exe"));
+    const QByteArray overlay("overlay data of no particular size");
+    {
+        QExe exeDat;
+        addDataDirectories(exeDat);
+        CHECK(!addSection(exeDat, ".data", QByteArray(0x30, 'd')).isNull());
+        exeDat.overlay()->setData(overlay);
+        CHECK(writeFile(exeDat, fileName));
+    }
+    const QByteArray written = fileData(fileName);
+    QExe exeDat;
+    CHECK(readFile(exeDat, fileName));
+    CHECK(exeDat.overlay()->data() == overlay);
+    // QFile::WriteOnly truncates the file it was read from before write() gets to it
+    CHECK(writeFile(exeDat, fileName));
+    CHECK(fileData(fileName) == written);
+    QExe reread;
+    CHECK(readFile(reread, fileName));
+    CHECK(reread.overlay()->data() == overlay);
+    return true;
+}
+
+// resources get moved up by an inserted section, which doesn't need base relocations since only RVAs point into them
+static bool testInsertBeforeRsrcWithoutRelocs()
+{
+    QExe exeDat;
+    addDataDirectories(exeDat);
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    QExeSectionPtr textSec = addSection(exeDat, ".text", QByteArray(0x40, '\xC3'),
+                                        QExeSection::ContainsCode | QExeSection::IsExecutable | QExeSection::IsReadable);
+    CHECK(!textSec.isNull());
+    QExeRsrcManager rsrcMgr;
+    QExeRsrcEntryPtr data = rsrcMgr.root()->createChild(QExeRsrcEntry::Directory, 10)->createChild(QExeRsrcEntry::Directory, 1)
+            ->createChild(QExeRsrcEntry::Data, 1033);
+    data->data = QByteArray("resource data");
+    CHECK(rsrcMgr.toSection(exeDat));
+    QExeSectionPtr rsrcSec = secMgr->sectionWithName(QLatin1String(".rsrc"));
+    DataDirectoryPtr rsrcDir = exeDat.optionalHeader()->dataDirectories[QExeOptionalHeader::ResourceTable];
+    rsrcDir->first = rsrcSec->virtualAddr;
+    rsrcDir->second = rsrcSec->virtualSize;
+    const quint32 oldRVA = rsrcSec->virtualAddr;
+
+    QExeSectionPtr newSec = QExeRsrcManager::addBeforeRsrcSection(secMgr, QLatin1String(".new"), QByteArray(0x20, 'n'),
+                                                                  QExeSection::ContainsInitializedData | QExeSection::IsReadable);
+    CHECK(!newSec.isNull());
+    CHECK(newSec->virtualAddr == oldRVA);
+    CHECK(rsrcSec->virtualAddr > oldRVA);
+    CHECK(rsrcDir->first == rsrcSec->virtualAddr);
+    QExeRsrcManager moved;
+    CHECK(moved.read(rsrcSec));
+    QExeRsrcEntryPtr movedData = moved.findFirst(QExeRsrcQuery(QStringLiteral("10/1/1033")));
+    CHECK(!movedData.isNull() && movedData->data == data->data);
+
+    // code may hold absolute addresses, which can't be found without relocations
+    QExeErrorInfo errinfo;
+    CHECK(!secMgr->insertSectionBefore(textSec, QExeSectionPtr(new QExeSection(QLatin1String(".new2"), 0x20u, QExeSection::ContainsUninitializedData)), &errinfo));
+    CHECK(errinfo.errorID == QExeErrorInfo::BadSection_UnsupportedFixup);
+    return true;
+}
+
+static QExeSectionPtr rsrcSection(quint32 nameID, const QByteArray &data)
+{
+    QExeRsrcManager rsrcMgr;
+    rsrcMgr.root()->createChild(QExeRsrcEntry::Directory, 10)->createChild(QExeRsrcEntry::Directory, nameID)
+            ->createChild(QExeRsrcEntry::Data, 1033)->data = data;
+    return rsrcMgr.toSection(0x100);
+}
+
+// handles keep the tree they were taken from alive when the manager reads another section or goes away
+static bool testHandlesAcrossRead()
+{
+    QExeRsrcManager rsrcMgr;
+    CHECK(rsrcMgr.read(rsrcSection(1, "first")));
+    QExeRsrcEntryPtr oldRoot = rsrcMgr.root();
+    QExeRsrcEntryPtr oldData = rsrcMgr.findFirst(QExeRsrcQuery(QStringLiteral("10/1/1033")));
+    CHECK(!oldData.isNull());
+
+    CHECK(rsrcMgr.read(rsrcSection(2, "second")));
+    CHECK(rsrcMgr.root() != oldRoot);
+    CHECK(oldRoot->manager() == nullptr);
+    CHECK(oldData->data == "first");
+    CHECK(oldData->path() == QStringLiteral("/*10/*1/*1033"));
+    CHECK(oldRoot->child(10)->child(1)->child(1033) == oldData);
+    CHECK(rsrcMgr.findFirst(QExeRsrcQuery(QStringLiteral("10/1/1033"))).isNull());
+    QExeRsrcEntryPtr newData = rsrcMgr.findFirst(QExeRsrcQuery(QStringLiteral("10/2/1033")));
+    CHECK(!newData.isNull() && newData->data == "second");
+
+    // entries of the old tree are copied into the new one
+    CHECK(rsrcMgr.root()->child(10)->addChild(oldRoot->child(10)->child(1)));
+    QExeRsrcEntryPtr copied = rsrcMgr.findFirst(QExeRsrcQuery(QStringLiteral("10/1/1033")));
+    CHECK(!copied.isNull() && copied != oldData && copied->data == "first");
+
+    // removed entries stay usable while they're referred to
+    QExeRsrcEntryPtr removed = rsrcMgr.root()->child(10)->removeChild(2);
+    CHECK(!removed.isNull() && removed->parent().isNull());
+    CHECK(removed->child(1033) == newData && newData->data == "second");
+
+    {
+        QExeRsrcManager tempMgr;
+        CHECK(tempMgr.read(rsrcSection(3, "third")));
+        oldData = tempMgr.findFirst(QExeRsrcQuery(QStringLiteral("10/3/1033")));
+    }
+    CHECK(!oldData.isNull() && oldData->manager() == nullptr && oldData->data == "third");
+    return true;
+}
+
+// children added out of order leave their directory unsorted, copies have to stay marked as such
+static bool testMergeUnsortedCopy()
+{
+    QExeRsrcManager source;
+    QExeRsrcEntryPtr sourceDir = source.root()->createChild(QExeRsrcEntry::Directory, 10);
+    const quint32 ids[] = { 5, 2, 9 };
+    for (quint32 id : ids)
+        sourceDir->createChild(QExeRsrcEntry::Data, id)->data = QByteArray::number(id);
+
+    // a detached directory looks its children up without the manager's index
+    QExeRsrcManager other;
+    QExeRsrcEntryPtr holder = other.root()->createChild(QExeRsrcEntry::Directory, 20);
+    CHECK(other.root()->removeChild(20) == holder);
+    CHECK(holder->addChild(sourceDir));
+    QExeRsrcEntryPtr copiedDir = holder->child(10);
+    CHECK(!copiedDir.isNull() && copiedDir != sourceDir);
+    for (quint32 id : ids)
+        CHECK(!copiedDir->child(id).isNull());
+    CHECK(holder->removeChild(10) == copiedDir);
+    CHECK(other.root()->addChild(copiedDir));
+
+    QExeRsrcManager base;
+    base.root()->createChild(QExeRsrcEntry::Directory, 10)->createChild(QExeRsrcEntry::Data, 2)->data = "old";
+    CHECK(QExeRsrcDiff::merge(base, other) == 3);
+    for (quint32 id : ids) {
+        QExeRsrcEntryPtr entry = base.root()->child(10)->child(id);
+        CHECK(!entry.isNull() && entry->data == QByteArray::number(id));
+    }
+    return true;
+}
+
+// the last section's raw data ends short of the file alignment, write() pads it out to the aligned file size
+static bool testChecksumAfterWrite()
+{
+    QExe exeDat;
+    addDataDirectories(exeDat);
+    CHECK(!addSection(exeDat, ".data", QByteArray(0x30, 'd')).isNull());
+    for (int pass = 0; pass < 2; pass++) {
+        // the second time around with an overlay, which goes after the padding
+        if (pass == 1)
+            exeDat.overlay()->setData(QByteArray("odd-sized overlay"));
+        QBuffer buf;
+        buf.open(QBuffer::ReadWrite);
+        CHECK(exeDat.write(buf));
+        quint32 checksum;
+        CHECK(exeDat.verifyChecksum(&checksum));
+        CHECK(checksum != 0);
+        QExe reread;
+        buf.seek(0);
+        CHECK(reread.read(buf));
+        CHECK(reread.verifyChecksum());
+    }
+    return true;
+}
+
+// without a certificate, the digest covers the whole written file but for the checksum and the certificate directory
+static bool testAuthenticodeDigestAfterWrite()
+{
+    QExe exeDat;
+    addDataDirectories(exeDat);
+    CHECK(!addSection(exeDat, ".data", QByteArray(0x30, 'd')).isNull());
+    exeDat.overlay()->setData(QByteArray("odd-sized overlay"));
+    QBuffer buf;
+    buf.open(QBuffer::ReadWrite);
+    CHECK(exeDat.write(buf));
+    const QByteArray file = buf.data();
+    CHECK(file.size() > 0x40);
+    // PE32: the checksum is 64 bytes into the optional header, the certificate directory 128 bytes in
+    const int optHeadPos = qFromLittleEndian<qint32>(reinterpret_cast<const uchar *>(file.constData()) + 0x3C) + 4 + 20;
+    const int checksumPos = optHeadPos + 64, certDirPos = optHeadPos + 128;
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(file.constData(), checksumPos);
+    hash.addData(file.constData() + checksumPos + 4, certDirPos - checksumPos - 4);
+    hash.addData(file.constData() + certDirPos + 8, file.size() - certDirPos - 8);
+    CHECK(exeDat.authenticodeDigest() == hash.result());
+    return true;
+}
+
+// sections changed in place after reading mustn't be mapped from the file anymore
+static bool testVirtualImageAfterChange()
+{
+    QTemporaryDir dir;
+    CHECK(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("mapped.exe"));
+    {
+        QExe exeDat;
+        // aligned to any page size the mapping could need
+        exeDat.optionalHeader()->fileAlign = 0x10000;
+        exeDat.optionalHeader()->sectionAlign = 0x10000;
+        addDataDirectories(exeDat);
+        CHECK(!addSection(exeDat, ".a", QByteArray(0x10000, 'a')).isNull());
+        CHECK(!addSection(exeDat, ".b", QByteArray(0x10000, 'b')).isNull());
+        CHECK(writeFile(exeDat, fileName));
+    }
+    QExe exeDat;
+    CHECK(readFile(exeDat, fileName));
+    QExeSectionPtr secB = exeDat.sectionManager()->sectionWithName(QLatin1String(".b"));
+    CHECK(!secB.isNull());
+    QSharedPointer<QExeVirtualImage> before = exeDat.virtualImage();
+    CHECK(!before.isNull());
+    CHECK(*before->pointer(secB->virtualAddr) == 'b');
+
+    // same buffer size and no reassignment, only the contents change
+    secB->rawData.data()[0] = 'x';
+    QSharedPointer<QExeVirtualImage> after = exeDat.virtualImage();
+    CHECK(!after.isNull());
+    CHECK(*after->pointer(secB->virtualAddr) == 'x');
+    CHECK(*after->pointer(secB->virtualAddr + 1) == 'b');
+    if (before->fileMappedSections() == 2)
+        CHECK(after->fileMappedSections() == 1);
+    return true;
+}
+
+static bool writeData(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    return QDir().mkpath(QFileInfo(fileName).path()) && file.open(QFile::WriteOnly) && file.write(data) == data.size();
+}
+
+// IDs only have one spelling, and data files need a type directory
+static bool testImportDirectoryPaths()
+{
+    QTemporaryDir dir;
+    CHECK(dir.isValid());
+    CHECK(writeData(dir.filePath(QStringLiteral("good/10/1/1033")), "good"));
+    CHECK(writeData(dir.filePath(QStringLiteral("zeros/10/01/1033")), "zeros"));
+    CHECK(writeData(dir.filePath(QStringLiteral("toplevel/1033")), "toplevel"));
+
+    QExeRsrcManager rsrcMgr;
+    CHECK(rsrcMgr.importDirectory(dir.filePath(QStringLiteral("good"))));
+    QExeRsrcEntryPtr entry = rsrcMgr.findFirst(QExeRsrcQuery(QStringLiteral("10/1/1033")));
+    CHECK(!entry.isNull() && entry->data == "good");
+
+    QExeErrorInfo zerosErr;
+    CHECK(!rsrcMgr.importDirectory(dir.filePath(QStringLiteral("zeros")), &zerosErr));
+    CHECK(zerosErr.errorID == QExeErrorInfo::BadRsrc_InvalidFormat);
+    CHECK(entry->data == "good");
+    QExeErrorInfo toplevelErr;
+    CHECK(!rsrcMgr.importDirectory(dir.filePath(QStringLiteral("toplevel")), &toplevelErr));
+    CHECK(toplevelErr.errorID == QExeErrorInfo::BadRsrc_InvalidFormat);
+    CHECK(rsrcMgr.root()->child(1033).isNull());
+    return true;
+}
+
+// patches either all land or none do, and reverting puts back what they replaced
+static bool testPatchSetApplyRevert()
+{
+    QExe exeDat;
+    addDataDirectories(exeDat);
+    QExeSectionPtr dataSec = addSection(exeDat, ".data", QByteArray(0x40, 'd'));
+    CHECK(!dataSec.isNull());
+    const QByteArray original = dataSec->rawData;
+    const quint32 rva = dataSec->virtualAddr;
+
+    QExePatchSet patches;
+    CHECK(patches.add(rva, QByteArray("dd"), QByteArray("XY")));
+    CHECK(patches.add(rva + 8, QByteArray(), QByteArray("Z")));
+    CHECK(!patches.add(rva + 16, QByteArray("ddd"), QByteArray("Z")));
+    CHECK(patches.count() == 2);
+
+    // one bad patch keeps the good one from being applied
+    QExePatchSet mismatched = patches;
+    CHECK(mismatched.add(rva + 16, QByteArray("zz"), QByteArray("QQ")));
+    QVector<QExePatchSet::Failure> failures;
+    CHECK(!mismatched.apply(exeDat, nullptr, &failures));
+    CHECK(failures.size() == 1 && failures[0].patch == 2 && failures[0].problem == QExePatchSet::Mismatch);
+    CHECK(dataSec->rawData == original);
+
+    CHECK(patches.apply(exeDat));
+    CHECK(dataSec->rawData.mid(0, 2) == "XY" && dataSec->rawData.at(8) == 'Z');
+    CHECK(dataSec->rawData.mid(2, 6) == original.mid(2, 6) && dataSec->rawData.mid(9) == original.mid(9));
+    // the same patches don't apply twice, since the expected bytes are gone
+    CHECK(!patches.validate(exeDat));
+    CHECK(patches.revert(exeDat));
+    CHECK(dataSec->rawData == original);
+    return true;
+}
+
+static QByteArray writeBytes(QExe &exeDat)
+{
+    QBuffer buf;
+    buf.open(QBuffer::ReadWrite);
+    return exeDat.write(buf) ? buf.data() : QByteArray();
+}
+
+static bool readBytes(QExe &exeDat, QByteArray data)
+{
+    QBuffer buf(&data);
+    return buf.open(QBuffer::ReadOnly) && exeDat.read(buf);
+}
+
+// a delta turns the source into the target, and only the source
+static bool testDeltaRoundTrip()
+{
+    QByteArray sourceBytes, targetBytes;
+    {
+        QExe exeDat;
+        addDataDirectories(exeDat);
+        CHECK(!addSection(exeDat, ".text", QByteArray(0x1000, '\xC3'),
+                          QExeSection::ContainsCode | QExeSection::IsExecutable | QExeSection::IsReadable).isNull());
+        QExeSectionPtr dataSec = addSection(exeDat, ".data", QByteArray(0x80, 'd'));
+        CHECK(!dataSec.isNull());
+        exeDat.overlay()->setData(QByteArray("source overlay"));
+        sourceBytes = writeBytes(exeDat);
+        dataSec->rawData.data()[0x10] = 'X';
+        CHECK(!addSection(exeDat, ".new", QByteArray(0x30, 'n')).isNull());
+        exeDat.overlay()->setData(QByteArray("source overlay, and then some"));
+        targetBytes = writeBytes(exeDat);
+    }
+    CHECK(!sourceBytes.isEmpty() && !targetBytes.isEmpty());
+    QExe source, target;
+    CHECK(readBytes(source, sourceBytes));
+    CHECK(readBytes(target, targetBytes));
+    const QByteArray delta = QExeDelta::create(source, target);
+    // the unchanged .text section is a single copy
+    CHECK(!delta.isEmpty() && delta.size() < 0x1000);
+
+    QExe exeDat;
+    CHECK(readBytes(exeDat, sourceBytes));
+    CHECK(QExeDelta::apply(exeDat, delta));
+    CHECK(writeBytes(exeDat) == targetBytes);
+
+    QExe other;
+    CHECK(readBytes(other, sourceBytes));
+    other.sectionManager()->sectionWithName(QLatin1String(".text"))->rawData.data()[0] = 'x';
+    QExeErrorInfo errinfo;
+    CHECK(!QExeDelta::apply(other, delta, &errinfo));
+    CHECK(errinfo.errorID == QExeErrorInfo::BadDelta_SourceMismatch);
+    return true;
+}
+
+struct Test {
+    const char *name;
+    bool (*run)();
+};
+
+static const Test tests[] = {
+    { "overlay in-place round trip", testOverlayInPlace },
+    { "section insertion before .rsrc without relocations", testInsertBeforeRsrcWithoutRelocs },
+    { "resource handles across QExeRsrcManager::read()", testHandlesAcrossRead },
+    { "resource merge of an unsorted copied tree", testMergeUnsortedCopy },
+    { "checksum after write() with an unaligned last section", testChecksumAfterWrite },
+    { "Authenticode digest after write() with an unaligned last section", testAuthenticodeDigestAfterWrite },
+    { "virtual image after an in-place section change", testVirtualImageAfterChange },
+    { "resource import paths", testImportDirectoryPaths },
+    { "patch set apply/revert", testPatchSetApplyRevert },
+    { "delta create/apply round trip", testDeltaRoundTrip },
+};
+
+int runTests()
+{
+    int failed = 0;
+    for (const Test &test : tests) {
+        bool ok = test.run();
+        OUT << (ok ? "PASS " : "FAIL ") << test.name;
+        if (!ok)
+            failed++;
+    }
+    OUT << failed << " of " << static_cast<int>(sizeof(tests) / sizeof(tests[0])) << " tests failed";
+    return failed;
+}
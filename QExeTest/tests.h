@@ -0,0 +1,8 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+// self-checks on images built on the fly, run with "QExeTest --tests"
+// returns the number of failed tests
+int runTests();
+
+#endif // TESTS_H
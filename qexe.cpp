@@ -3,6 +3,16 @@
 #include <QtEndian>
 #include <QBuffer>
 #include <QDataStream>
+#include <QFile>
+#include <QFileDevice>
+#include <QFileInfo>
+
+#include <algorithm>
+
+#include "qexechecksum_p.h"
+
+// overlays up to this size are loaded on read, bigger ones are streamed from the source file on write
+static const qint64 overlayStreamThreshold = 16 * 1024 * 1024;
 
 static QMap<QLatin1String, QExeOptionalHeader::DataDirectories> secName2DataDir {
     { QLatin1String(".edata"), QExeOptionalHeader::ExportTable },
@@ -31,6 +41,7 @@ bool QExe::dataDirSectionName(QExeOptionalHeader::DataDirectories dataDir, QLati
 QExe::QExe(QObject *parent) : QObject(parent)
 {
     m_autoAddFillerSections = true;
+    m_updateChecksum = true;
     reset();
 }
 
@@ -40,6 +51,7 @@ void QExe::reset()
     m_coffHead = QSharedPointer<QExeCOFFHeader>(new QExeCOFFHeader(this));
     m_optHead = QSharedPointer<QExeOptionalHeader>(new QExeOptionalHeader(this));
     m_secMgr = QSharedPointer<QExeSectionManager>(new QExeSectionManager(this));
+    m_overlay = QSharedPointer<QExeOverlay>(new QExeOverlay(this));
 }
 
 #define SET_ERROR_INFO(errName) \
@@ -102,6 +114,40 @@ bool QExe::read(QIODevice &src, QExeErrorInfo *errinfo)
     // read sections
     if (!m_secMgr->read(src, ds, errinfo))
         return false;
+    QFileDevice *file = qobject_cast<QFileDevice *>(&src);
+    m_sourceFileName.clear();
+    if (file != nullptr && !file->fileName().isEmpty()) {
+        QFileInfo info(file->fileName());
+        m_sourceFileName = info.absoluteFilePath();
+        m_sourceSize = info.size();
+        m_sourceModified = info.lastModified();
+    }
+    // anything after the last section is the overlay
+    qint64 overlayPos = m_optHead->headerSize;
+    QExeSectionPtr section;
+    foreach (section, m_secMgr->sections) {
+        if (section->rawData.size() > 0)
+            overlayPos = qMax<qint64>(overlayPos, static_cast<qint64>(section->rawDataPtr) + section->rawData.size());
+    }
+    // write() pads the last section to the file alignment, which isn't part of the overlay
+    const qint64 alignedPos = qMin(alignForward<qint64>(overlayPos, m_optHead->fileAlign), src.size());
+    if (alignedPos > overlayPos) {
+        src.seek(overlayPos);
+        const QByteArray pad = src.read(alignedPos - overlayPos);
+        if (pad.size() == alignedPos - overlayPos && pad.count('\0') == pad.size())
+            overlayPos = alignedPos;
+    }
+    m_overlay->clear();
+    if (src.size() > overlayPos) {
+        // big overlays of files are streamed on write, so they don't have to be loaded
+        if (file != nullptr && !file->fileName().isEmpty() && src.size() - overlayPos > overlayStreamThreshold)
+            m_overlay->setSource(m_sourceFileName, overlayPos, src.size() - overlayPos);
+        else {
+            src.seek(overlayPos);
+            m_overlay->setData(src.readAll());
+        }
+        m_overlay->m_filePos = overlayPos;
+    }
 
     return true;
 }
@@ -117,35 +163,84 @@ bool QExe::write(QIODevice &dst, QExeErrorInfo *errinfo)
         SET_ERROR_INFO(BadIODevice_Sequential)
         return false;
     }
-    QDataStream ds(&dst);
-    ds.setByteOrder(QDataStream::LittleEndian);
 
     // make sure everyone's up to date & calculate expected file size
     quint32 fileSize;
     if (!updateComponents(&fileSize, errinfo))
         return false;
 
+    if (!m_overlay->isLoaded()) {
+        // streaming the overlay from the file being overwritten won't end well
+        // (if dst was opened truncated, the overlay is gone already, which is caught here before anything is written)
+        QFileDevice *file = qobject_cast<QFileDevice *>(&dst);
+        if (file != nullptr && QFileInfo(file->fileName()).canonicalFilePath() == QFileInfo(m_overlay->sourceFileName()).canonicalFilePath()) {
+            if (!m_overlay->load(errinfo))
+                return false;
+        } else if (!m_overlay->sourceAvailable()) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadOverlay_SourceUnavailable;
+                errinfo->details += m_overlay->sourceFileName();
+            }
+            return false;
+        }
+    }
+    // the overlay goes right after the last section
+    relocateOverlay(fileSize);
+
+    // checksum everything on its way out, so the file doesn't need to be read back
+    QExeChecksumDevice checksumDev(&dst, checksumOffset());
+    QIODevice &out = m_updateChecksum ? checksumDev : dst;
+    if (m_updateChecksum)
+        checksumDev.open(QIODevice::WriteOnly);
+    QDataStream ds(&out);
+    ds.setByteOrder(QDataStream::LittleEndian);
+
     // write DOS stub
-    dst.write(m_dosStub->data);
+    out.write(m_dosStub->data);
     // write PE signature
     ds.setByteOrder(QDataStream::BigEndian);
     ds << static_cast<quint32>(0x50450000);
     ds.setByteOrder(QDataStream::LittleEndian);
     // write COFF header
-    if (!m_coffHead->write(dst, ds, errinfo))
+    if (!m_coffHead->write(out, ds, errinfo))
         return false;
     // write optional header
-    if (!m_optHead->write(dst, ds, errinfo))
+    if (!m_optHead->write(out, ds, errinfo))
         return false;
     // write sections
-    if (!m_secMgr->write(dst, ds, errinfo))
+    if (!m_secMgr->write(out, ds, errinfo))
         return false;
 
     // pad EXE to expected file size
-    int padSize = static_cast<int>(fileSize - dst.pos());
+    int padSize = static_cast<int>(fileSize - out.pos());
     if (padSize > 0) {
         QByteArray pad(padSize, 0);
-        dst.write(pad);
+        out.write(pad);
+    }
+    // write overlay
+    if (!m_overlay->isEmpty()) {
+        out.seek(fileSize);
+        if (!m_overlay->read(0, m_overlay->size(), [&out](const char *data, qint64 len) {
+            return out.write(data, len) == len;
+        })) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadOverlay_SourceUnavailable;
+                errinfo->details += m_overlay->sourceFileName();
+            }
+            return false;
+        }
+    }
+
+    // patch in the checksum
+    if (m_updateChecksum) {
+        qint64 end = qMax<qint64>(fileSize, checksumDev.end());
+        checksumDev.close();
+        m_optHead->checksum = checksumDev.checksum(static_cast<quint32>(end));
+        uchar checksumBytes[4];
+        qToLittleEndian<quint32>(m_optHead->checksum, checksumBytes);
+        dst.seek(checksumOffset());
+        dst.write(reinterpret_cast<const char *>(checksumBytes), 4);
+        dst.seek(end);
     }
 
     // remove filler sections
@@ -175,6 +270,11 @@ QSharedPointer<QExeSectionManager> QExe::sectionManager() const
     return m_secMgr;
 }
 
+QSharedPointer<QExeOverlay> QExe::overlay() const
+{
+    return m_overlay;
+}
+
 void QExe::updateHeaderSizes()
 {
     m_coffHead->optHeadSize = static_cast<quint16>(m_optHead->size());
@@ -206,8 +306,18 @@ bool QExe::updateComponents(quint32 *fileSize, QExeErrorInfo *errinfo)
             int dirID = secName2DataDir[secName];
             if (dirID < m_optHead->dataDirectories.size()) {
                 DataDirectoryPtr rsrcDir = m_optHead->dataDirectories[dirID];
-                rsrcDir->first = section->virtualAddr;
-                rsrcDir->second = section->virtualSize;
+                // leave directories that were moved into another section alone (e.g. by QExeImportBuilder)
+                bool elsewhere = false;
+                QExeSectionPtr other;
+                foreach (other, m_secMgr->sections) {
+                    if (other != section && rsrcDir->first >= other->virtualAddr
+                            && rsrcDir->first - other->virtualAddr < qMax(other->virtualSize, static_cast<quint32>(other->rawData.size())))
+                        elsewhere = true;
+                }
+                if (!elsewhere) {
+                    rsrcDir->first = section->virtualAddr;
+                    rsrcDir->second = section->virtualSize;
+                }
             }
         } else if (QStringLiteral(".text").compare(secName) == 0)
             m_optHead->codeBaseAddr = section->virtualAddr;
@@ -287,3 +397,208 @@ void QExe::setAutoAddFillerSections(bool autoAddFillerSections)
 {
     m_autoAddFillerSections = autoAddFillerSections;
 }
+
+bool QExe::updateChecksum() const
+{
+    return m_updateChecksum;
+}
+
+void QExe::setUpdateChecksum(bool updateChecksum)
+{
+    m_updateChecksum = updateChecksum;
+}
+
+quint32 QExe::calculateChecksum()
+{
+    // lay the image out the way write() does, so the result matches what it writes
+    quint32 fileSize;
+    if (!updateComponents(&fileSize, nullptr))
+        return 0;
+    relocateOverlay(fileSize);
+    // sum the serialized headers, then the section data at their file offsets
+    // the zero padding up to fileSize doesn't change the sum, but it does count towards the size
+    QByteArray headers = serializeHeaders();
+    const qint64 checksumPos = checksumOffset();
+    quint64 sum = 0;
+    QExeChecksum::addRange(&sum, 0, reinterpret_cast<const uchar *>(headers.constData()), headers.size(), checksumPos);
+    qint64 end = qMax<qint64>(fileSize, headers.size());
+    QExeSectionPtr section;
+    foreach (section, m_secMgr->sections) {
+        if (section->rawData.size() == 0)
+            continue;
+        QExeChecksum::addRange(&sum, section->rawDataPtr, reinterpret_cast<const uchar *>(section->rawData.constData()),
+                               section->rawData.size(), checksumPos);
+        end = qMax<qint64>(end, static_cast<qint64>(section->rawDataPtr) + section->rawData.size());
+    }
+    if (!m_overlay->isEmpty()) {
+        qint64 pos = m_overlay->filePos();
+        m_overlay->read(0, m_overlay->size(), [&sum, &pos, checksumPos](const char *data, qint64 len) {
+            QExeChecksum::addRange(&sum, pos, reinterpret_cast<const uchar *>(data), len, checksumPos);
+            pos += len;
+            return true;
+        });
+        end = qMax(end, m_overlay->filePos() + m_overlay->size());
+    }
+    if (m_autoAddFillerSections)
+        removeFillerSections();
+    return QExeChecksum::finish(sum, static_cast<quint32>(end));
+}
+
+bool QExe::verifyChecksum(quint32 *actual)
+{
+    quint32 checksum = calculateChecksum();
+    if (actual != nullptr)
+        *actual = checksum;
+    return checksum == m_optHead->checksum;
+}
+
+QByteArray QExe::authenticodeDigest(QCryptographicHash::Algorithm algorithm)
+{
+    // lay the image out the way write() does, so the digest matches what it writes
+    quint32 fileSize;
+    if (!updateComponents(&fileSize, nullptr))
+        return QByteArray();
+    relocateOverlay(fileSize);
+    // the header area is hashed as it would be written: serialized headers, zero-padded up to SizeOfHeaders
+    QByteArray headers = serializeHeaders();
+    if (static_cast<quint32>(headers.size()) < m_optHead->headerSize)
+        headers.append(static_cast<int>(m_optHead->headerSize) - headers.size(), '\0');
+    const char *head = headers.constData();
+    const int headSize = qMax(static_cast<int>(m_optHead->headerSize), headers.size());
+    const int checksumPos = static_cast<int>(checksumOffset());
+    QCryptographicHash hash(algorithm);
+    hash.addData(head, checksumPos);
+    if (m_optHead->dataDirectories.size() > QExeOptionalHeader::CertificateTable) {
+        const int certDirPos = static_cast<int>(dataDirectoryOffset(QExeOptionalHeader::CertificateTable));
+        hash.addData(head + checksumPos + 4, certDirPos - checksumPos - 4);
+        hash.addData(head + certDirPos + 8, headSize - certDirPos - 8);
+    } else
+        hash.addData(head + checksumPos + 4, headSize - checksumPos - 4);
+    // then every section's raw data, in file order
+    QVector<QExeSectionPtr> sections = m_secMgr->sections;
+    std::sort(sections.begin(), sections.end(), [](const QExeSectionPtr &sec1, const QExeSectionPtr &sec2) {
+        return sec1->rawDataPtr < sec2->rawDataPtr;
+    });
+    // fed in chunks, so huge sections don't need to be hashed in one call
+    const int chunkSize = 1024 * 1024;
+    qint64 end = headSize;
+    QExeSectionPtr section;
+    foreach (section, sections) {
+        const char *data = section->rawData.constData();
+        for (int pos = 0; pos < section->rawData.size(); pos += chunkSize)
+            hash.addData(data + pos, qMin(chunkSize, section->rawData.size() - pos));
+        if (section->rawData.size() != 0)
+            end = qMax<qint64>(end, static_cast<qint64>(section->rawDataPtr) + section->rawData.size());
+    }
+    if (m_autoAddFillerSections)
+        removeFillerSections();
+    // then whatever follows the last section, starting with the padding up to the aligned file size
+    if (end < fileSize)
+        hash.addData(QByteArray(static_cast<int>(fileSize - end), '\0'));
+    // and the overlay, minus the certificate table
+    if (!m_overlay->isEmpty()) {
+        auto addChunks = [&hash, chunkSize](const char *data, qint64 len) {
+            for (qint64 pos = 0; pos < len; pos += chunkSize)
+                hash.addData(data + pos, static_cast<int>(qMin<qint64>(chunkSize, len - pos)));
+            return true;
+        };
+        qint64 certPos = m_overlay->size(), certSize = 0;
+        if (m_optHead->dataDirectories.size() > QExeOptionalHeader::CertificateTable) {
+            DataDirectoryPtr certDir = m_optHead->dataDirectories[QExeOptionalHeader::CertificateTable];
+            qint64 rel = static_cast<qint64>(certDir->first) - m_overlay->filePos();
+            if (certDir->second != 0 && rel >= 0 && rel < m_overlay->size()) {
+                certPos = rel;
+                certSize = qMin<qint64>(certDir->second, m_overlay->size() - rel);
+            }
+        }
+        m_overlay->read(0, certPos, addChunks);
+        m_overlay->read(certPos + certSize, m_overlay->size() - certPos - certSize, addChunks);
+    }
+    return hash.result();
+}
+
+QSharedPointer<QExeVirtualImage> QExe::virtualImage(QExeErrorInfo *errinfo)
+{
+    quint32 imageSize = m_optHead->headerSize;
+    QExeSectionPtr section;
+    foreach (section, m_secMgr->sections)
+        imageSize = qMax(imageSize, section->virtualAddr + qMax(section->virtualSize, static_cast<quint32>(section->rawData.size())));
+    imageSize = alignForward(imageSize, m_optHead->sectionAlign);
+    QSharedPointer<QExeVirtualImage> image(new QExeVirtualImage());
+    if (!image->allocate(imageSize)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadVirtualImage_AllocationFailure;
+            errinfo->details += imageSize;
+        }
+        return nullptr;
+    }
+    QByteArray headers = serializeHeaders();
+    memcpy(image->data(), headers.constData(), qMin(static_cast<size_t>(headers.size()), static_cast<size_t>(imageSize)));
+    QFile source;
+    if (sourceUnchanged()) {
+        source.setFileName(m_sourceFileName);
+        source.open(QIODevice::ReadOnly);
+    }
+    foreach (section, m_secMgr->sections) {
+        // the loader only maps raw data up to the (section-aligned) virtual size
+        quint32 len = static_cast<quint32>(section->rawData.size());
+        if (section->virtualSize != 0)
+            len = qMin(len, alignForward(section->virtualSize, m_optHead->sectionAlign));
+        if (len == 0)
+            continue;
+        if (source.isOpen() && section->isFileBacked() && image->mapFile(source, section->filePos, section->virtualAddr, len))
+            continue;
+        memcpy(image->data() + section->virtualAddr, section->rawData.constData(), len);
+    }
+    return image;
+}
+
+bool QExe::sourceUnchanged() const
+{
+    if (m_sourceFileName.isEmpty())
+        return false;
+    QFileInfo info(m_sourceFileName);
+    return info.exists() && info.size() == m_sourceSize && info.lastModified() == m_sourceModified;
+}
+
+void QExe::relocateOverlay(qint64 newPos)
+{
+    const qint64 oldPos = m_overlay->filePos();
+    // the certificate table is addressed by file offset, so it has to move with the overlay
+    if (m_optHead->dataDirectories.size() > QExeOptionalHeader::CertificateTable) {
+        DataDirectoryPtr certDir = m_optHead->dataDirectories[QExeOptionalHeader::CertificateTable];
+        if (certDir->second != 0 && certDir->first >= oldPos && certDir->first < oldPos + m_overlay->size())
+            certDir->first = static_cast<quint32>(certDir->first + (newPos - oldPos));
+    }
+    m_overlay->m_filePos = newPos;
+}
+
+QByteArray QExe::serializeHeaders()
+{
+    QByteArray headers;
+    QBuffer buf(&headers);
+    buf.open(QBuffer::WriteOnly);
+    QDataStream ds(&buf);
+    buf.write(m_dosStub->data);
+    ds.setByteOrder(QDataStream::BigEndian);
+    ds << static_cast<quint32>(0x50450000);
+    ds.setByteOrder(QDataStream::LittleEndian);
+    m_coffHead->write(buf, ds, nullptr);
+    m_optHead->write(buf, ds, nullptr);
+    m_secMgr->writeHeaders(buf, ds);
+    buf.close();
+    return headers;
+}
+
+qint64 QExe::dataDirectoryOffset(int dataDir) const
+{
+    // data directories are the last thing in the optional header
+    return static_cast<qint64>(m_dosStub->size()) + 4 + m_coffHead->size() + m_optHead->size()
+            - static_cast<qint64>(m_optHead->dataDirectories.size() - dataDir) * 8;
+}
+
+qint64 QExe::checksumOffset() const
+{
+    // DOS stub, PE signature, COFF header, then 64 bytes into the optional header (same for PE32 and PE32+)
+    return static_cast<qint64>(m_dosStub->size()) + 4 + m_coffHead->size() + 64;
+}
@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include <QIODevice>
+#include <QCryptographicHash>
+#include <QDateTime>
 
 #include "QExe_global.h"
 #include "qexeerrorinfo.h"
@@ -11,6 +13,8 @@
 #include "qexeoptionalheader.h"
 #include "qexesectionmanager.h"
 #include "qexersrcmanager.h"
+#include "qexeoverlay.h"
+#include "qexevirtualimage.h"
 
 class QEXE_EXPORT QExe : QObject
 {
@@ -32,11 +36,25 @@ public:
     QSharedPointer<QExeCOFFHeader> coffHeader() const;
     QSharedPointer<QExeOptionalHeader> optionalHeader() const;
     QSharedPointer<QExeSectionManager> sectionManager() const;
+    QSharedPointer<QExeOverlay> overlay() const;
     bool autoAddFillerSections() const;
     void setAutoAddFillerSections(bool autoAddFillerSections);
+    bool updateChecksum() const;
+    void setUpdateChecksum(bool updateChecksum);
+    // checksum of the file write() would produce, calculated from the headers, section data and overlay
+    // updates the headers and moves the overlay the way write() does, returns 0 if the image can't be laid out
+    quint32 calculateChecksum();
+    bool verifyChecksum(quint32 *actual = nullptr);
+    // Authenticode image digest of the file write() would produce, calculated from the headers, section data, padding
+    // and overlay (excludes the checksum, the CertificateTable directory entry and the certificate data)
+    // lays the image out like calculateChecksum() does, returns an empty digest if it can't be
+    QByteArray authenticodeDigest(QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256);
+    // flat copy of the image as laid out in memory, indexed by RVA (see QExeVirtualImage)
+    QSharedPointer<QExeVirtualImage> virtualImage(QExeErrorInfo *errinfo = nullptr);
 
 private:
     friend class QExeCOFFHeader;
+    friend class QExeDelta;
     friend class QExeOptionalHeader;
     friend class QExeSectionManager;
     friend class QExeRsrcManager;
@@ -44,10 +62,21 @@ private:
     void updateHeaderSizes();
     bool updateComponents(quint32 *fileSize, QExeErrorInfo *error);
     bool m_autoAddFillerSections;
+    bool m_updateChecksum;
+    qint64 checksumOffset() const;
+    qint64 dataDirectoryOffset(int dataDir) const;
+    QByteArray serializeHeaders();
     QSharedPointer<QExeDOSStub> m_dosStub;
     QSharedPointer<QExeCOFFHeader> m_coffHead;
     QSharedPointer<QExeOptionalHeader> m_optHead;
     QSharedPointer<QExeSectionManager> m_secMgr;
+    QSharedPointer<QExeOverlay> m_overlay;
+    // file the image was read from, if any, so unchanged sections can be mapped from it
+    QString m_sourceFileName;
+    qint64 m_sourceSize;
+    QDateTime m_sourceModified;
+    bool sourceUnchanged() const;
+    void relocateOverlay(qint64 newPos);
     bool isFillerSection(QExeSectionPtr sec);
     QExeSectionPtr createFillerSection(int num, quint32 addr, quint32 size);
     void addFillerSections();
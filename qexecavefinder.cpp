@@ -0,0 +1,159 @@
+#include "qexecavefinder.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+#include "qexe.h"
+#include "qexeconcurrent_p.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QEXE_CAVEFINDER_SSE2
+#endif
+
+// sections are searched in parallel once there's this much data
+static const quint64 caveParallelThreshold = 4 * 1024 * 1024;
+
+static inline bool isPaddingByte(char b)
+{
+    return b == '\x00' || b == '\xCC' || b == '\x90';
+}
+
+// first position in [pos, size) holding a padding byte, or size
+static quint32 nextPaddingByte(const char *data, quint32 pos, quint32 size)
+{
+#ifdef QEXE_CAVEFINDER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i int3 = _mm_set1_epi8('\xCC');
+    const __m128i nop = _mm_set1_epi8('\x90');
+    for (; size - pos >= 16; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        const __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, zero), _mm_or_si128(_mm_cmpeq_epi8(block, int3), _mm_cmpeq_epi8(block, nop)));
+        const uint bits = static_cast<uint>(_mm_movemask_epi8(hits));
+        if (bits != 0)
+            return pos + qCountTrailingZeroBits(bits);
+    }
+#endif
+    for (; pos < size; pos++) {
+        if (isPaddingByte(data[pos]))
+            break;
+    }
+    return pos;
+}
+
+// first position in [pos, size) not holding fill, or size
+static quint32 runEnd(const char *data, quint32 pos, quint32 size, char fill)
+{
+#ifdef QEXE_CAVEFINDER_SSE2
+    const __m128i fills = _mm_set1_epi8(fill);
+    for (; size - pos >= 16; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        const uint bits = static_cast<uint>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, fills)));
+        if (bits != 0xFFFF)
+            return pos + qCountTrailingZeroBits(~bits);
+    }
+#endif
+    for (; pos < size; pos++) {
+        if (data[pos] != fill)
+            break;
+    }
+    return pos;
+}
+
+QVector<QExeCaveFinder::Cave> QExeCaveFinder::find(const QExe &exeDat, quint32 minSize)
+{
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    QVector<QExeSectionPtr> sections;
+    for (int i = 0; i < secMgr->sectionCount(); i++) {
+        QExeSectionPtr section = secMgr->sectionAt(i);
+        if (section->characteristics.testFlag(QExeSection::ContainsCode))
+            sections += section;
+    }
+    return find(exeDat, sections, minSize);
+}
+
+QVector<QExeCaveFinder::Cave> QExeCaveFinder::find(const QExe &exeDat, const QVector<QExeSectionPtr> &sections, quint32 minSize)
+{
+    QVector<QVector<Cave>> results(sections.size());
+    quint64 total = 0;
+    QExeSectionPtr section;
+    foreach (section, sections)
+        total += static_cast<quint64>(section->rawData.size());
+    QExeConcurrent::forEachIndex(sections.size(), total >= caveParallelThreshold, [&sections, &results, minSize](int i) {
+        findRuns(sections[i], minSize, &results[i]);
+    });
+    QVector<Cave> ret;
+    for (int i = 0; i < sections.size(); i++) {
+        ret += results[i];
+        quint32 slack = slackSize(exeDat, sections[i]);
+        if (slack >= minSize && slack > 0) {
+            const quint32 rawSize = static_cast<quint32>(sections[i]->rawData.size());
+            Cave cave = { sections[i], sections[i]->virtualAddr + rawSize, sections[i]->rawDataPointer() + rawSize, slack, '\0', true };
+            ret += cave;
+        }
+    }
+    std::sort(ret.begin(), ret.end(), [](const Cave &cave1, const Cave &cave2) {
+        return cave1.size != cave2.size ? cave1.size > cave2.size : cave1.rva < cave2.rva;
+    });
+    return ret;
+}
+
+quint32 QExeCaveFinder::slackSize(const QExe &exeDat, QExeSectionPtr section)
+{
+    // a section without raw data doesn't have a place in the file yet
+    const quint32 rawSize = static_cast<quint32>(section->rawData.size());
+    if (rawSize == 0)
+        return 0;
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    quint32 limit = QExe::alignForward(rawSize, optHead->fileAlign);
+    // the loader only maps raw data up to the virtual size, so that may have to grow too, but not into the next section
+    limit = qMin(limit, QExe::alignForward(qMax(section->virtualSize, rawSize), optHead->sectionAlign));
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    for (int i = 0; i < secMgr->sectionCount(); i++) {
+        QExeSectionPtr other = secMgr->sectionAt(i);
+        if (other == section)
+            continue;
+        if (other->virtualAddr > section->virtualAddr)
+            limit = qMin(limit, other->virtualAddr - section->virtualAddr);
+        if (!other->rawData.isEmpty() && other->rawDataPointer() > section->rawDataPointer())
+            limit = qMin(limit, other->rawDataPointer() - section->rawDataPointer());
+    }
+    return limit > rawSize ? limit - rawSize : 0;
+}
+
+bool QExeCaveFinder::extendIntoSlack(QExe &exeDat, QExeSectionPtr section, quint32 size, QExeErrorInfo *errinfo)
+{
+    if (size > slackSize(exeDat, section)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadSection_InsufficientSlack;
+            errinfo->details += section->name();
+            errinfo->details += size;
+        }
+        return false;
+    }
+    section->rawData.append(QByteArray(static_cast<int>(size), '\0'));
+    const quint32 rawSize = static_cast<quint32>(section->rawData.size());
+    if (section->virtualSize < rawSize)
+        section->virtualSize = rawSize;
+    return true;
+}
+
+void QExeCaveFinder::findRuns(const QExeSectionPtr &section, quint32 minSize, QVector<Cave> *out)
+{
+    const char *data = section->rawData.constData();
+    // padding past the virtual size isn't loaded
+    quint32 size = static_cast<quint32>(section->rawData.size());
+    if (section->virtualSize != 0)
+        size = qMin(size, section->virtualSize);
+    quint32 pos = 0;
+    while ((pos = nextPaddingByte(data, pos, size)) < size) {
+        const char fill = data[pos];
+        const quint32 end = runEnd(data, pos, size, fill);
+        if (end - pos >= minSize && end > pos) {
+            Cave cave = { section, section->virtualAddr + pos, section->rawDataPointer() + pos, end - pos, fill, false };
+            *out += cave;
+        }
+        pos = end;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef QEXECAVEFINDER_H
+#define QEXECAVEFINDER_H
+
+#include "QExe_global.h"
+
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+#include "qexesection.h"
+
+class QExe;
+
+// finds room for injected code: runs of padding (0x00, 0xCC or 0x90) inside code sections,
+// and the slack between a section's raw data and its file-aligned size
+class QEXE_EXPORT QExeCaveFinder
+{
+public:
+    struct Cave {
+        QExeSectionPtr section;
+        quint32 rva;
+        quint32 filePos; // as read or last written, see QExeSection::rawDataPointer()
+        quint32 size;
+        char fill; // padding byte, 0 for slack
+        bool isSlack; // past the section's raw data, has to be claimed with extendIntoSlack() before use
+    };
+
+    // caves of at least minSize bytes in every section containing code, largest first
+    static QVector<Cave> find(const QExe &exeDat, quint32 minSize);
+    static QVector<Cave> find(const QExe &exeDat, const QVector<QExeSectionPtr> &sections, quint32 minSize);
+    // how far the section's raw data can grow without moving anything, in the file or in memory
+    static quint32 slackSize(const QExe &exeDat, QExeSectionPtr section);
+    // grows the section's raw data (and virtual size, if needed) by size zero bytes, taken from its slack
+    static bool extendIntoSlack(QExe &exeDat, QExeSectionPtr section, quint32 size, QExeErrorInfo *errinfo = nullptr);
+private:
+    static void findRuns(const QExeSectionPtr &section, quint32 minSize, QVector<Cave> *out);
+};
+
+#endif // QEXECAVEFINDER_H
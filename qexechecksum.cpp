@@ -0,0 +1,121 @@
+#include "qexechecksum_p.h"
+
+#include <QtEndian>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QEXE_CHECKSUM_SSE2
+#endif
+
+quint64 QExeChecksum::sumWords(const uchar *data, qint64 len)
+{
+    quint64 sum = 0;
+    qint64 i = 0;
+#ifdef QEXE_CHECKSUM_SSE2
+    // widen each 16-bit word to 32 bits and add 4 lanes at a time
+    // a lane can take 0x10001 words before overflowing, so flush into sum well before that
+    const __m128i zero = _mm_setzero_si128();
+    while (len - i >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        qint64 blockEnd = i + qMin<qint64>((len - i) & ~static_cast<qint64>(15), 16 * 0x4000);
+        for (; i < blockEnd; i += 16) {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(words, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(words, zero));
+        }
+        quint32 lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+        sum += static_cast<quint64>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; i + 1 < len; i += 2)
+        sum += qFromLittleEndian<quint16>(data + i);
+    return sum;
+}
+
+void QExeChecksum::addRange(quint64 *sum, qint64 pos, const uchar *data, qint64 len, qint64 skipPos)
+{
+    // split around the checksum field
+    if (pos < skipPos + 4 && pos + len > skipPos) {
+        if (pos < skipPos)
+            addRange(sum, pos, data, skipPos - pos, skipPos);
+        qint64 skipEnd = skipPos + 4;
+        if (pos + len > skipEnd)
+            addRange(sum, skipEnd, data + (skipEnd - pos), pos + len - skipEnd, skipPos);
+        return;
+    }
+    if (len <= 0)
+        return;
+    // a byte at an odd offset is the high half of its word
+    if (pos & 1) {
+        *sum += static_cast<quint64>(data[0]) << 8;
+        pos++, data++, len--;
+    }
+    *sum += sumWords(data, len & ~static_cast<qint64>(1));
+    if (len & 1)
+        *sum += data[len - 1];
+}
+
+quint32 QExeChecksum::finish(quint64 sum, quint32 fileSize)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<quint32>(sum) + fileSize;
+}
+
+QExeChecksumDevice::QExeChecksumDevice(QIODevice *dst, qint64 checksumPos)
+{
+    m_dst = dst;
+    m_checksumPos = checksumPos;
+    m_end = 0;
+    m_sum = 0;
+}
+
+bool QExeChecksumDevice::open(OpenMode mode)
+{
+    if (!QIODevice::open(mode | Unbuffered))
+        return false;
+    return QIODevice::seek(m_dst->pos());
+}
+
+bool QExeChecksumDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 QExeChecksumDevice::size() const
+{
+    return m_dst->size();
+}
+
+bool QExeChecksumDevice::seek(qint64 pos)
+{
+    return QIODevice::seek(pos) && m_dst->seek(pos);
+}
+
+qint64 QExeChecksumDevice::end() const
+{
+    return m_end;
+}
+
+quint32 QExeChecksumDevice::checksum(quint32 fileSize) const
+{
+    return QExeChecksum::finish(m_sum, fileSize);
+}
+
+qint64 QExeChecksumDevice::readData(char *data, qint64 maxSize)
+{
+    (void)data, (void)maxSize;
+    return -1;
+}
+
+qint64 QExeChecksumDevice::writeData(const char *data, qint64 maxSize)
+{
+    const qint64 pos = this->pos();
+    qint64 written = m_dst->write(data, maxSize);
+    if (written > 0) {
+        QExeChecksum::addRange(&m_sum, pos, reinterpret_cast<const uchar *>(data), written, m_checksumPos);
+        m_end = qMax(m_end, pos + written);
+    }
+    return written;
+}
@@ -0,0 +1,40 @@
+#ifndef QEXECHECKSUM_P_H
+#define QEXECHECKSUM_P_H
+
+#include <QIODevice>
+
+// PE image checksum: every 16-bit little-endian word of the file (minus the checksum field) is summed,
+// folded to 16 bits with end-around carry, then the file size is added
+namespace QExeChecksum {
+
+// sum of the little-endian words in data, len must be even
+quint64 sumWords(const uchar *data, qint64 len);
+// adds data (which starts at file offset pos) to sum, skipping the 4 bytes at skipPos
+void addRange(quint64 *sum, qint64 pos, const uchar *data, qint64 len, qint64 skipPos);
+quint32 finish(quint64 sum, quint32 fileSize);
+
+}
+
+// pass-through device that checksums everything written to dst
+// writes may seek around, but must not overlap (which QExe::write guarantees)
+class QExeChecksumDevice : public QIODevice
+{
+public:
+    QExeChecksumDevice(QIODevice *dst, qint64 checksumPos);
+    bool open(OpenMode mode) override;
+    bool isSequential() const override;
+    qint64 size() const override;
+    bool seek(qint64 pos) override;
+    qint64 end() const;
+    quint32 checksum(quint32 fileSize) const;
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+private:
+    QIODevice *m_dst;
+    qint64 m_checksumPos;
+    qint64 m_end;
+    quint64 m_sum;
+};
+
+#endif // QEXECHECKSUM_P_H
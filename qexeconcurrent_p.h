@@ -0,0 +1,27 @@
+#ifndef QEXECONCURRENT_P_H
+#define QEXECONCURRENT_P_H
+
+#include <QVector>
+#include <QtConcurrent>
+
+#include <numeric>
+
+namespace QExeConcurrent {
+
+// calls function(i) for every i in [0, count), spread across the global thread pool if parallel is true
+template<typename Function>
+void forEachIndex(int count, bool parallel, Function function)
+{
+    if (!parallel || count < 2) {
+        for (int i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+    QVector<int> indexes(count);
+    std::iota(indexes.begin(), indexes.end(), 0);
+    QtConcurrent::blockingMap(indexes, [&function](int &i) { function(i); });
+}
+
+}
+
+#endif // QEXECONCURRENT_P_H
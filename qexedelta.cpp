@@ -0,0 +1,312 @@
+#include "qexedelta.h"
+
+#include <QBuffer>
+#include <QHash>
+#include <QtEndian>
+
+#include <climits>
+#include <cstring>
+
+#include "qexe.h"
+#include "qexeconcurrent_p.h"
+#include "qexehash_p.h"
+
+#define SET_ERROR_INFO(errName) \
+    if (errinfo != nullptr) { \
+        errinfo->errorID = QExeErrorInfo::errName; \
+    }
+
+static const char deltaMagic[4] = { 'Q', 'E', 'X', 'D' };
+static const char deltaVersion = 1;
+// sources are indexed in blocks of this size, so shorter matches aren't found
+static const quint32 deltaBlockSize = 32;
+static const quint32 deltaHashBase = 0x01000193;
+// blobs are diffed in parallel once there's this much data
+static const quint64 deltaParallelThreshold = 4 * 1024 * 1024;
+
+enum DeltaSource : quint8 {
+    NoSource,
+    HeaderSource,
+    OverlaySource,
+    SectionSource
+};
+
+// a contiguous range of the target file, and what it's diffed against
+struct DeltaBlob {
+    quint32 filePos;
+    QByteArray data;
+    DeltaSource source;
+    QByteArray sectionName;
+    QByteArray sourceData;
+};
+
+static void writeVarint(QByteArray *out, quint64 value)
+{
+    while (value >= 0x80) {
+        *out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    *out += static_cast<char>(value);
+}
+
+static bool readVarint(const char *&pos, const char *end, quint64 *value)
+{
+    *value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        const uchar b = static_cast<uchar>(*pos++);
+        *value |= static_cast<quint64>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static quint32 blockHash(const uchar *data)
+{
+    quint32 hash = 0;
+    for (quint32 i = 0; i < deltaBlockSize; i++)
+        hash = hash * deltaHashBase + data[i];
+    return hash;
+}
+
+// ops are a varint (length << 1 | isCopy), followed by either the copy's source offset (zigzag encoded, relative to
+// the end of the previous copy) or the literal bytes; a zero ends the list
+static void encodeOps(const QByteArray &source, const QByteArray &target, QByteArray *out)
+{
+    const uchar *src = reinterpret_cast<const uchar *>(source.constData());
+    const uchar *dst = reinterpret_cast<const uchar *>(target.constData());
+    const quint32 srcSize = static_cast<quint32>(source.size());
+    const quint32 dstSize = static_cast<quint32>(target.size());
+    qint64 lastEnd = 0;
+    auto emitCopy = [out, &lastEnd](quint32 offset, quint32 length) {
+        writeVarint(out, (static_cast<quint64>(length) << 1) | 1);
+        const qint64 rel = static_cast<qint64>(offset) - lastEnd;
+        writeVarint(out, rel < 0 ? (static_cast<quint64>(-rel) << 1) - 1 : static_cast<quint64>(rel) << 1);
+        lastEnd = static_cast<qint64>(offset) + length;
+    };
+    auto emitLiteral = [out, dst](quint32 start, quint32 end) {
+        if (end == start)
+            return;
+        writeVarint(out, static_cast<quint64>(end - start) << 1);
+        out->append(reinterpret_cast<const char *>(dst + start), static_cast<int>(end - start));
+    };
+    // unchanged data is a single copy
+    if (srcSize == dstSize && memcmp(src, dst, srcSize) == 0) {
+        if (dstSize != 0)
+            emitCopy(0, dstSize);
+        writeVarint(out, 0);
+        return;
+    }
+    QHash<quint32, quint32> blocks; // hash => offset
+    blocks.reserve(static_cast<int>(srcSize / deltaBlockSize));
+    for (quint32 offset = 0; srcSize - offset >= deltaBlockSize; offset += deltaBlockSize)
+        blocks.insert(blockHash(src + offset), offset);
+    quint32 power = 1;
+    for (quint32 i = 1; i < deltaBlockSize; i++)
+        power *= deltaHashBase;
+    quint32 pos = 0, literal = 0;
+    quint32 hash = dstSize >= deltaBlockSize ? blockHash(dst) : 0;
+    while (!blocks.isEmpty() && dstSize - pos >= deltaBlockSize) {
+        auto it = blocks.constFind(hash);
+        if (it != blocks.constEnd() && memcmp(src + it.value(), dst + pos, deltaBlockSize) == 0) {
+            // grow the match both ways, backwards only into bytes that would otherwise be literals
+            quint32 s = it.value(), d = pos;
+            while (d > literal && s > 0 && src[s - 1] == dst[d - 1]) {
+                s--;
+                d--;
+            }
+            quint32 length = pos + deltaBlockSize - d;
+            while (s + length < srcSize && d + length < dstSize && src[s + length] == dst[d + length])
+                length++;
+            emitLiteral(literal, d);
+            emitCopy(s, length);
+            pos = literal = d + length;
+            if (dstSize - pos >= deltaBlockSize)
+                hash = blockHash(dst + pos);
+            continue;
+        }
+        // roll the window forward by a byte
+        if (dstSize - pos > deltaBlockSize)
+            hash = (hash - dst[pos] * power) * deltaHashBase + dst[pos + deltaBlockSize];
+        pos++;
+    }
+    emitLiteral(literal, dstSize);
+    writeVarint(out, 0);
+}
+
+static bool decodeOps(const char *&pos, const char *end, const QByteArray &source, char *dst, quint64 size)
+{
+    quint64 written = 0;
+    qint64 lastEnd = 0;
+    for (;;) {
+        quint64 op;
+        if (!readVarint(pos, end, &op))
+            return false;
+        if (op == 0)
+            break;
+        const quint64 length = op >> 1;
+        if (length > size - written)
+            return false;
+        if ((op & 1) != 0) {
+            quint64 rel;
+            if (!readVarint(pos, end, &rel))
+                return false;
+            const qint64 offset = lastEnd + ((rel & 1) != 0 ? -static_cast<qint64>((rel + 1) >> 1) : static_cast<qint64>(rel >> 1));
+            if (offset < 0 || static_cast<quint64>(offset) + length > static_cast<quint64>(source.size()))
+                return false;
+            memcpy(dst + written, source.constData() + offset, length);
+            lastEnd = offset + static_cast<qint64>(length);
+        } else {
+            if (static_cast<quint64>(end - pos) < length)
+                return false;
+            memcpy(dst + written, pos, length);
+            pos += length;
+        }
+        written += length;
+    }
+    return written == size;
+}
+
+QByteArray QExeDelta::create(QExe &source, QExe &target)
+{
+    QVector<DeltaBlob> blobs;
+    DeltaBlob headers = { 0, target.serializeHeaders(), HeaderSource, QByteArray(), source.serializeHeaders() };
+    blobs += headers;
+    QSharedPointer<QExeSectionManager> srcSecMgr = source.sectionManager();
+    QSharedPointer<QExeSectionManager> dstSecMgr = target.sectionManager();
+    for (int i = 0; i < dstSecMgr->sectionCount(); i++) {
+        QExeSectionPtr section = dstSecMgr->sectionAt(i);
+        if (section->rawData.isEmpty())
+            continue;
+        DeltaBlob blob = { section->rawDataPointer(), section->rawData, NoSource, QByteArray(), QByteArray() };
+        QExeSectionPtr srcSection = srcSecMgr->sectionWithName(section->name());
+        if (!srcSection.isNull() && !srcSection->rawData.isEmpty()) {
+            blob.source = SectionSource;
+            blob.sectionName = QByteArray(section->name().data(), section->name().size());
+            blob.sourceData = srcSection->rawData;
+        }
+        blobs += blob;
+    }
+    QSharedPointer<QExeOverlay> overlay = target.overlay();
+    if (!overlay->isEmpty()) {
+        DeltaBlob blob = { static_cast<quint32>(overlay->filePos()), overlay->data(), NoSource, QByteArray(), QByteArray() };
+        if (!source.overlay()->isEmpty()) {
+            blob.source = OverlaySource;
+            blob.sourceData = source.overlay()->data();
+        }
+        blobs += blob;
+    }
+
+    quint64 fileSize = 0, total = 0;
+    foreach (const DeltaBlob &blob, blobs) {
+        fileSize = qMax(fileSize, static_cast<quint64>(blob.filePos) + blob.data.size());
+        total += static_cast<quint64>(blob.data.size());
+    }
+    QVector<QByteArray> encoded(blobs.size());
+    QExeConcurrent::forEachIndex(blobs.size(), total >= deltaParallelThreshold, [&blobs, &encoded](int i) {
+        const DeltaBlob &blob = blobs[i];
+        QByteArray *out = &encoded[i];
+        writeVarint(out, blob.filePos);
+        writeVarint(out, static_cast<quint64>(blob.data.size()));
+        *out += static_cast<char>(blob.source);
+        if (blob.source == SectionSource) {
+            writeVarint(out, static_cast<quint64>(blob.sectionName.size()));
+            *out += blob.sectionName;
+        }
+        if (blob.source != NoSource) {
+            writeVarint(out, static_cast<quint64>(blob.sourceData.size()));
+            char hash[8];
+            qToLittleEndian<quint64>(QExeHash::fnv1a(blob.sourceData), hash);
+            out->append(hash, 8);
+        }
+        encodeOps(blob.sourceData, blob.data, out);
+    });
+
+    QByteArray ret(deltaMagic, 4);
+    ret += deltaVersion;
+    writeVarint(&ret, fileSize);
+    writeVarint(&ret, static_cast<quint64>(blobs.size()));
+    foreach (const QByteArray &blob, encoded)
+        ret += blob;
+    return ret;
+}
+
+bool QExeDelta::apply(QExe &exeDat, const QByteArray &delta, QExeErrorInfo *errinfo)
+{
+    const char *pos = delta.constData();
+    const char *end = pos + delta.size();
+    quint64 fileSize, blobCount;
+    if (delta.size() < 5 || memcmp(pos, deltaMagic, 4) != 0 || pos[4] != deltaVersion) {
+        SET_ERROR_INFO(BadDelta_InvalidFormat)
+        return false;
+    }
+    pos += 5;
+    if (!readVarint(pos, end, &fileSize) || !readVarint(pos, end, &blobCount) || fileSize > INT_MAX) {
+        SET_ERROR_INFO(BadDelta_InvalidFormat)
+        return false;
+    }
+    QByteArray file(static_cast<int>(fileSize), '\0');
+    char *dst = file.data();
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    for (quint64 i = 0; i < blobCount; i++) {
+        quint64 filePos, size;
+        if (!readVarint(pos, end, &filePos) || !readVarint(pos, end, &size) || filePos > fileSize || size > fileSize - filePos
+                || pos >= end) {
+            SET_ERROR_INFO(BadDelta_InvalidFormat)
+            return false;
+        }
+        const quint8 source = static_cast<quint8>(*pos++);
+        QByteArray sourceData;
+        bool found = true;
+        switch (source) {
+        case NoSource:
+            break;
+        case HeaderSource:
+            sourceData = exeDat.serializeHeaders();
+            break;
+        case OverlaySource:
+            sourceData = exeDat.overlay()->data();
+            break;
+        case SectionSource: {
+            quint64 nameSize;
+            if (!readVarint(pos, end, &nameSize) || static_cast<quint64>(end - pos) < nameSize) {
+                SET_ERROR_INFO(BadDelta_InvalidFormat)
+                return false;
+            }
+            QExeSectionPtr section = secMgr->sectionWithName(QLatin1String(pos, static_cast<int>(nameSize)));
+            pos += nameSize;
+            if (section.isNull())
+                found = false;
+            else
+                sourceData = section->rawData;
+            break;
+        }
+        default:
+            SET_ERROR_INFO(BadDelta_InvalidFormat)
+            return false;
+        }
+        if (source != NoSource) {
+            quint64 sourceSize;
+            if (!readVarint(pos, end, &sourceSize) || end - pos < 8) {
+                SET_ERROR_INFO(BadDelta_InvalidFormat)
+                return false;
+            }
+            const quint64 hash = qFromLittleEndian<quint64>(pos);
+            pos += 8;
+            if (!found || sourceSize != static_cast<quint64>(sourceData.size()) || hash != QExeHash::fnv1a(sourceData)) {
+                if (errinfo != nullptr) {
+                    errinfo->errorID = QExeErrorInfo::BadDelta_SourceMismatch;
+                    errinfo->details += filePos;
+                }
+                return false;
+            }
+        }
+        if (!decodeOps(pos, end, sourceData, dst + filePos, size)) {
+            SET_ERROR_INFO(BadDelta_InvalidFormat)
+            return false;
+        }
+    }
+    QBuffer buf(&file);
+    buf.open(QIODevice::ReadOnly);
+    return exeDat.read(buf, errinfo);
+}
@@ -0,0 +1,25 @@
+#ifndef QEXEDELTA_H
+#define QEXEDELTA_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+
+#include "qexeerrorinfo.h"
+
+class QExe;
+
+// section-level binary diff between two images
+// the headers, every section (matched up with the source's by name) and the overlay are diffed separately against
+// their counterpart, by looking up a rolling hash of the target in a table of the source's blocks, so an unchanged
+// section costs a single copy op and sections are diffed in parallel
+class QEXE_EXPORT QExeDelta
+{
+public:
+    // target is expected to be laid out as read or last written, since file offsets are taken from it
+    static QByteArray create(QExe &source, QExe &target);
+    // rebuilds the target from exeDat (which has to match the source create() was given) and reads it into exeDat
+    static bool apply(QExe &exeDat, const QByteArray &delta, QExeErrorInfo *errinfo = nullptr);
+};
+
+#endif // QEXEDELTA_H
@@ -24,8 +24,31 @@ public:
         // BadSection
         BadSection_VirtualOverlap = 2 * 0x100,
         BadSection_LinearizeFailure,
+        BadSection_DuplicateName,
+        BadSection_InsufficientHeaderSpace,
+        BadSection_UnsupportedFixup,
+        BadSection_InsufficientSlack,
+        BadSection_InvalidIndex,
         // BadRsrc
         BadRsrc_InvalidFormat = 3 * 0x100,
+        BadRsrc_EntryNotFound,
+        BadRsrc_InsufficientSpace,
+        BadRsrc_EncodeFailure,
+        // BadOverlay
+        BadOverlay_SourceUnavailable = 4 * 0x100,
+        // BadDataDir
+        BadDataDir_Unmapped = 5 * 0x100,
+        BadDataDir_InvalidFormat,
+        // BadRebase
+        BadRebase_InvalidBase = 6 * 0x100,
+        BadRebase_FixupOutOfRange,
+        // BadVirtualImage
+        BadVirtualImage_AllocationFailure = 7 * 0x100,
+        // BadPatch
+        BadPatch_ValidationFailed = 8 * 0x100,
+        // BadDelta
+        BadDelta_InvalidFormat = 9 * 0x100,
+        BadDelta_SourceMismatch,
     };
     Q_ENUM(ErrorID)
     ErrorID errorID;
@@ -0,0 +1,126 @@
+#include "qexeexceptiontable.h"
+
+#include "qexe.h"
+
+static const quint32 runtimeFunctionSize = 12;
+
+QExeExceptionTable::QExeExceptionTable()
+{
+    m_entries = nullptr;
+    m_count = 0;
+}
+
+bool QExeExceptionTable::read(const QExe &exeDat, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    m_entries = nullptr;
+    m_count = 0;
+    if (optHead->dataDirectories.size() <= QExeOptionalHeader::ExceptionTable)
+        return true;
+    DataDirectoryPtr dir = optHead->dataDirectories[QExeOptionalHeader::ExceptionTable];
+    if (dir->first == 0 || dir->second == 0)
+        return true;
+    return read(QExeRVAResolver(*exeDat.sectionManager()), dir->first, dir->second, errinfo);
+}
+
+bool QExeExceptionTable::read(const QExeRVAResolver &resolver, quint32 rva, quint32 size, QExeErrorInfo *errinfo)
+{
+    m_resolver = resolver;
+    m_entries = nullptr;
+    m_count = 0;
+    const quint32 count = size / runtimeFunctionSize;
+    if (count == 0)
+        return true;
+    const char *entries = m_resolver.pointer(rva, count * runtimeFunctionSize);
+    if (entries == nullptr || count > 0x7FFFFFFF / runtimeFunctionSize) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    m_entries = entries;
+    m_count = static_cast<int>(count);
+    // binary search only works if the entries are sorted and don't overlap, which the spec requires
+    for (int i = 0; i < m_count; i++) {
+        if (beginAt(i) >= endAt(i) || (i > 0 && endAt(i - 1) > beginAt(i))) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+                errinfo->details += rva + static_cast<quint32>(i) * runtimeFunctionSize;
+            }
+            m_entries = nullptr;
+            m_count = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+int QExeExceptionTable::functionCount() const
+{
+    return m_count;
+}
+
+QExeExceptionTable::Function QExeExceptionTable::functionAt(int index) const
+{
+    Function ret = {};
+    if (index < 0 || index >= m_count)
+        return ret;
+    const char *entry = m_entries + index * runtimeFunctionSize;
+    ret.beginRVA = qFromLittleEndian<quint32>(entry);
+    ret.endRVA = qFromLittleEndian<quint32>(entry + 4);
+    ret.unwindInfoRVA = qFromLittleEndian<quint32>(entry + 8);
+    return ret;
+}
+
+int QExeExceptionTable::indexOf(quint32 rva) const
+{
+    // find the first function ending after rva
+    int lo = 0, hi = m_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (endAt(mid) <= rva)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < m_count && beginAt(lo) <= rva ? lo : -1;
+}
+
+bool QExeExceptionTable::find(quint32 rva, Function *out) const
+{
+    int index = indexOf(rva);
+    if (index < 0)
+        return false;
+    if (out != nullptr)
+        *out = functionAt(index);
+    return true;
+}
+
+QVector<int> QExeExceptionTable::indexesOf(const QVector<quint32> &rvas) const
+{
+    QVector<int> ret;
+    ret.reserve(rvas.size());
+    int index = 0;
+    quint32 prev = 0;
+    foreach (quint32 rva, rvas) {
+        // out of order, so the merge can't continue from where it was
+        if (rva < prev)
+            index = 0;
+        prev = rva;
+        while (index < m_count && endAt(index) <= rva)
+            index++;
+        ret += index < m_count && beginAt(index) <= rva ? index : -1;
+    }
+    return ret;
+}
+
+quint32 QExeExceptionTable::beginAt(int index) const
+{
+    return qFromLittleEndian<quint32>(m_entries + index * runtimeFunctionSize);
+}
+
+quint32 QExeExceptionTable::endAt(int index) const
+{
+    return qFromLittleEndian<quint32>(m_entries + index * runtimeFunctionSize + 4);
+}
@@ -0,0 +1,43 @@
+#ifndef QEXEEXCEPTIONTABLE_H
+#define QEXEEXCEPTIONTABLE_H
+
+#include "QExe_global.h"
+
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+#include "qexervaresolver.h"
+
+class QExe;
+
+// lazy view over the ExceptionTable data directory (x64 RUNTIME_FUNCTION entries)
+// the entries are checked to be sorted once when read, lookups then binary search the section data directly
+class QEXE_EXPORT QExeExceptionTable
+{
+public:
+    struct Function {
+        quint32 beginRVA;
+        quint32 endRVA; // exclusive
+        quint32 unwindInfoRVA;
+    };
+
+    QExeExceptionTable();
+    bool read(const QExe &exeDat, QExeErrorInfo *errinfo = nullptr);
+    bool read(const QExeRVAResolver &resolver, quint32 rva, quint32 size, QExeErrorInfo *errinfo = nullptr);
+    int functionCount() const;
+    Function functionAt(int index) const;
+    // index of the function containing rva, or -1
+    int indexOf(quint32 rva) const;
+    bool find(quint32 rva, Function *out = nullptr) const;
+    // same as indexOf for every RVA, in one merge pass if rvas is sorted
+    QVector<int> indexesOf(const QVector<quint32> &rvas) const;
+private:
+    quint32 beginAt(int index) const;
+    quint32 endAt(int index) const;
+
+    QExeRVAResolver m_resolver;
+    const char *m_entries;
+    int m_count;
+};
+
+#endif // QEXEEXCEPTIONTABLE_H
@@ -0,0 +1,178 @@
+#include "qexeexporttable.h"
+
+#include "qexe.h"
+
+static const quint32 exportDirSize = 40;
+
+QExeExportTable::QExeExportTable()
+{
+    m_valid = false;
+    m_rva = m_size = 0;
+    m_timestamp = 0;
+    m_ordinalBase = m_functionCount = m_nameCount = 0;
+    m_functions = m_names = m_nameOrdinals = nullptr;
+}
+
+bool QExeExportTable::read(const QExe &exeDat, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    m_valid = false;
+    if (optHead->dataDirectories.size() <= QExeOptionalHeader::ExportTable)
+        return true;
+    DataDirectoryPtr dir = optHead->dataDirectories[QExeOptionalHeader::ExportTable];
+    if (dir->first == 0)
+        return true;
+    return read(QExeRVAResolver(*exeDat.sectionManager()), dir->first, dir->second, errinfo);
+}
+
+bool QExeExportTable::read(const QExeRVAResolver &resolver, quint32 rva, quint32 size, QExeErrorInfo *errinfo)
+{
+    m_valid = false;
+    m_resolver = resolver;
+    m_rva = rva;
+    m_size = size;
+    const char *dir = m_resolver.pointer(rva, exportDirSize);
+    if (dir == nullptr) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    m_timestamp = qFromLittleEndian<quint32>(dir + 4);
+    m_version = Version16(qFromLittleEndian<quint16>(dir + 8), qFromLittleEndian<quint16>(dir + 10));
+    quint32 nameRVA = qFromLittleEndian<quint32>(dir + 12);
+    m_ordinalBase = qFromLittleEndian<quint32>(dir + 16);
+    m_functionCount = qFromLittleEndian<quint32>(dir + 20);
+    m_nameCount = qFromLittleEndian<quint32>(dir + 24);
+    quint32 functionsRVA = qFromLittleEndian<quint32>(dir + 28);
+    quint32 namesRVA = qFromLittleEndian<quint32>(dir + 32);
+    quint32 nameOrdinalsRVA = qFromLittleEndian<quint32>(dir + 36);
+    m_moduleName = m_resolver.string(nameRVA);
+    // the tables themselves have to be there, but their entries are only checked when used
+    m_functions = m_functionCount == 0 ? nullptr : m_resolver.pointer(functionsRVA, m_functionCount * 4);
+    m_names = m_nameCount == 0 ? nullptr : m_resolver.pointer(namesRVA, m_nameCount * 4);
+    m_nameOrdinals = m_nameCount == 0 ? nullptr : m_resolver.pointer(nameOrdinalsRVA, m_nameCount * 2);
+    if (m_functionCount > 0x3FFFFFFF || m_nameCount > 0x3FFFFFFF
+            || (m_functionCount != 0 && m_functions == nullptr)
+            || (m_nameCount != 0 && (m_names == nullptr || m_nameOrdinals == nullptr))) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    m_valid = true;
+    return true;
+}
+
+bool QExeExportTable::isValid() const
+{
+    return m_valid;
+}
+
+QLatin1String QExeExportTable::moduleName() const
+{
+    return m_moduleName;
+}
+
+quint32 QExeExportTable::timestamp() const
+{
+    return m_timestamp;
+}
+
+Version16 QExeExportTable::version() const
+{
+    return m_version;
+}
+
+quint32 QExeExportTable::ordinalBase() const
+{
+    return m_ordinalBase;
+}
+
+quint32 QExeExportTable::functionCount() const
+{
+    return m_valid ? m_functionCount : 0;
+}
+
+quint32 QExeExportTable::nameCount() const
+{
+    return m_valid ? m_nameCount : 0;
+}
+
+QLatin1String QExeExportTable::nameAt(quint32 index) const
+{
+    if (!m_valid || index >= m_nameCount)
+        return QLatin1String();
+    return m_resolver.string(qFromLittleEndian<quint32>(m_names + index * 4));
+}
+
+bool QExeExportTable::findByName(const QLatin1String &name, Export *out) const
+{
+    if (!m_valid || name.isEmpty())
+        return false;
+    // the loader compares names with strcmp, so do the same
+    quint32 lo = 0, hi = m_nameCount;
+    while (lo < hi) {
+        quint32 mid = lo + (hi - lo) / 2;
+        QLatin1String midName = nameAt(mid);
+        if (midName.data() == nullptr)
+            return false;
+        int cmp = memcmp(midName.data(), name.data(), static_cast<size_t>(qMin(midName.size(), name.size())));
+        if (cmp == 0)
+            cmp = midName.size() - name.size();
+        if (cmp == 0) {
+            quint16 index = qFromLittleEndian<quint16>(m_nameOrdinals + mid * 2);
+            if (!makeExport(index, out))
+                return false;
+            if (out != nullptr)
+                out->name = midName;
+            return true;
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+bool QExeExportTable::findByName(const QString &name, Export *out) const
+{
+    const QByteArray latin1 = name.toLatin1();
+    return findByName(QLatin1String(latin1.constData(), latin1.size()), out);
+}
+
+bool QExeExportTable::findByOrdinal(quint32 ordinal, Export *out) const
+{
+    if (!m_valid || ordinal < m_ordinalBase)
+        return false;
+    if (!makeExport(ordinal - m_ordinalBase, out))
+        return false;
+    if (out != nullptr)
+        out->name = QLatin1String();
+    return true;
+}
+
+bool QExeExportTable::makeExport(quint32 index, Export *out) const
+{
+    if (index >= m_functionCount)
+        return false;
+    quint32 rva = qFromLittleEndian<quint32>(m_functions + index * 4);
+    // unused slots in the address table are zero
+    if (rva == 0)
+        return false;
+    if (out == nullptr)
+        return true;
+    out->ordinal = m_ordinalBase + index;
+    // an address inside the export directory is a forwarder string, not code
+    if (rva >= m_rva && rva - m_rva < m_size) {
+        out->rva = 0;
+        out->forwarder = m_resolver.string(rva);
+    } else {
+        out->rva = rva;
+        out->forwarder = QLatin1String();
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef QEXEEXPORTTABLE_H
+#define QEXEEXPORTTABLE_H
+
+#include "QExe_global.h"
+
+#include <QLatin1String>
+
+#include "qexeerrorinfo.h"
+#include "typedef_version.h"
+#include "qexervaresolver.h"
+
+class QExe;
+
+// lazy view over the ExportTable data directory
+// only the directory itself is checked when read, entries are looked up straight from the section data
+class QEXE_EXPORT QExeExportTable
+{
+public:
+    struct Export {
+        quint32 ordinal; // biased by ordinalBase(), as used by importers
+        QLatin1String name; // null if looked up by ordinal
+        quint32 rva; // 0 if forwarded
+        QLatin1String forwarder; // "DLL.Function" or "DLL.#Ordinal", null if not forwarded
+    };
+
+    QExeExportTable();
+    bool read(const QExe &exeDat, QExeErrorInfo *errinfo = nullptr);
+    bool read(const QExeRVAResolver &resolver, quint32 rva, quint32 size, QExeErrorInfo *errinfo = nullptr);
+    bool isValid() const;
+
+    QLatin1String moduleName() const;
+    quint32 timestamp() const;
+    Version16 version() const;
+    quint32 ordinalBase() const;
+    quint32 functionCount() const;
+    quint32 nameCount() const;
+    // names are in name pointer table order, which the spec requires to be sorted
+    QLatin1String nameAt(quint32 index) const;
+    // binary search over the name pointer table
+    bool findByName(const QLatin1String &name, Export *out = nullptr) const;
+    bool findByName(const QString &name, Export *out = nullptr) const;
+    // direct index into the export address table
+    bool findByOrdinal(quint32 ordinal, Export *out = nullptr) const;
+private:
+    bool makeExport(quint32 index, Export *out) const;
+
+    QExeRVAResolver m_resolver;
+    bool m_valid;
+    quint32 m_rva;
+    quint32 m_size;
+    QLatin1String m_moduleName;
+    quint32 m_timestamp;
+    Version16 m_version;
+    quint32 m_ordinalBase;
+    quint32 m_functionCount;
+    quint32 m_nameCount;
+    const char *m_functions; // export address table
+    const char *m_names; // name pointer table
+    const char *m_nameOrdinals; // ordinal table
+};
+
+#endif // QEXEEXPORTTABLE_H
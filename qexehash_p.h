@@ -0,0 +1,28 @@
+#ifndef QEXEHASH_P_H
+#define QEXEHASH_P_H
+
+#include <QByteArray>
+
+// 64-bit FNV-1a, for telling blobs apart without comparing them byte by byte
+// not collision-resistant, so only meant for data that isn't chosen by an attacker
+namespace QExeHash {
+
+inline quint64 fnv1a(const char *data, int size)
+{
+    quint64 hash = Q_UINT64_C(0xCBF29CE484222325);
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= Q_UINT64_C(0x100000001B3);
+    }
+    return hash;
+}
+
+inline quint64 fnv1a(const QByteArray &data)
+{
+    return fnv1a(data.constData(), data.size());
+}
+
+}
+
+#endif // QEXEHASH_P_H
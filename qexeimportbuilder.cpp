@@ -0,0 +1,232 @@
+#include "qexeimportbuilder.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#include "qexe.h"
+#include "qexeimporttable.h"
+
+static const quint32 descriptorSize = 20;
+
+// added functions of one module, in the order they were added
+struct ImportGroup {
+    QByteArray name;
+    QVector<int> functions;
+};
+
+QExeImportBuilder::QExeImportBuilder()
+{
+}
+
+int QExeImportBuilder::addFunction(const QString &module, const QString &function, quint16 hint)
+{
+    Function newFunc;
+    newFunc.module = module;
+    newFunc.name = function.toLatin1();
+    newFunc.hint = hint;
+    newFunc.ordinal = 0;
+    newFunc.addressRVA = 0;
+    return add(newFunc, moduleKey(module) + '!' + newFunc.name);
+}
+
+int QExeImportBuilder::addFunction(const QString &module, quint16 ordinal)
+{
+    Function newFunc;
+    newFunc.module = module;
+    newFunc.hint = 0;
+    newFunc.ordinal = ordinal;
+    newFunc.addressRVA = 0;
+    return add(newFunc, moduleKey(module) + '#' + QByteArray::number(ordinal));
+}
+
+int QExeImportBuilder::functionCount() const
+{
+    return m_functions.size();
+}
+
+void QExeImportBuilder::clear()
+{
+    m_functions.clear();
+    m_index.clear();
+    m_section.clear();
+}
+
+bool QExeImportBuilder::build(QExe &exeDat, const QLatin1String &secName, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    m_section.clear();
+    if (optHead->dataDirectories.size() <= QExeOptionalHeader::ImportTable) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+            errinfo->details += optHead->dataDirectories.size();
+        }
+        return false;
+    }
+    QExeImportTable imports;
+    if (!imports.read(exeDat, errinfo))
+        return false;
+    // functions that are imported already just get their existing IAT slot
+    QVector<ImportGroup> groups;
+    QHash<QByteArray, int> groupIndex;
+    for (int i = 0; i < m_functions.size(); i++) {
+        Function &function = m_functions[i];
+        const QExeImportTable::Function *existing = function.name.isEmpty() ? imports.function(function.module, function.ordinal)
+                                                                           : imports.function(function.module, QString::fromLatin1(function.name));
+        if (existing != nullptr) {
+            function.addressRVA = existing->addressRVA;
+            continue;
+        }
+        function.addressRVA = 0;
+        const QByteArray key = moduleKey(function.module);
+        auto it = groupIndex.constFind(key);
+        if (it == groupIndex.constEnd()) {
+            ImportGroup group;
+            group.name = function.module.toLatin1();
+            it = groupIndex.insert(key, groups.size());
+            groups += group;
+        }
+        groups[it.value()].functions += i;
+    }
+    if (groups.isEmpty())
+        return true;
+    if (!secMgr->canAddSectionHeader(errinfo))
+        return false;
+
+    // lay everything out first, so the section data is allocated once:
+    // descriptors, address tables, lookup tables, hint/name entries, module names
+    const bool isPlus = optHead->isPlus;
+    const quint32 thunkSize = isPlus ? 8 : 4;
+    const quint32 descSize = static_cast<quint32>(imports.moduleCount() + groups.size() + 1) * descriptorSize;
+    quint32 thunkCount = 0, hintNameSize = 0, moduleNameSize = 0;
+    foreach (const ImportGroup &group, groups) {
+        thunkCount += static_cast<quint32>(group.functions.size()) + 1;
+        foreach (int index, group.functions) {
+            if (!m_functions[index].name.isEmpty())
+                hintNameSize += QExe::alignForward(static_cast<quint32>(m_functions[index].name.size()) + 3, 2u);
+        }
+        moduleNameSize += static_cast<quint32>(group.name.size()) + 1;
+    }
+    // keeping the address tables together lets one ImportAddrTable entry cover all of them
+    const quint32 iatOffset = QExe::alignForward(descSize, 8u);
+    const quint32 iltOffset = iatOffset + thunkCount * thunkSize;
+    const quint32 hintNameOffset = iltOffset + thunkCount * thunkSize;
+    const quint32 moduleNameOffset = hintNameOffset + hintNameSize;
+    const quint32 totalSize = moduleNameOffset + moduleNameSize;
+
+    QExeSectionPtr newSec(new QExeSection(secName, QByteArray(static_cast<int>(totalSize), '\0'),
+                                          QExeSection::ContainsInitializedData | QExeSection::IsReadable | QExeSection::IsWritable));
+    newSec->virtualSize = totalSize;
+    // goes after the last section
+    newSec->virtualAddr = 0;
+    for (int i = 0; i < secMgr->sectionCount(); i++) {
+        QExeSectionPtr section = secMgr->sectionAt(i);
+        quint32 end = section->virtualAddr + qMax(section->virtualSize, static_cast<quint32>(section->rawData.size()));
+        newSec->virtualAddr = qMax(newSec->virtualAddr, QExe::alignForward(end, optHead->sectionAlign));
+    }
+    if (!secMgr->addSection(newSec)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadSection_DuplicateName;
+            errinfo->details += secName;
+        }
+        return false;
+    }
+
+    const quint32 base = newSec->virtualAddr;
+    char *data = newSec->rawData.data();
+    auto writeThunk = [isPlus](char *dst, quint64 thunk) {
+        if (isPlus)
+            qToLittleEndian<quint64>(thunk, dst);
+        else
+            qToLittleEndian<quint32>(static_cast<quint32>(thunk), dst);
+    };
+    // existing descriptors are copied as they are, except that they're no longer bound (the loader fills their
+    // address tables in from the lookup tables again), unless they have no lookup table to do that with
+    char *desc = data;
+    for (int i = 0; i < imports.moduleCount(); i++, desc += descriptorSize) {
+        const QExeImportTable::Module &module = imports.moduleAt(i);
+        qToLittleEndian<quint32>(module.lookupRVA, desc);
+        qToLittleEndian<quint32>(module.lookupRVA != 0 ? 0 : module.timestamp, desc + 4);
+        qToLittleEndian<quint32>(module.forwarderChain, desc + 8);
+        qToLittleEndian<quint32>(module.nameRVA, desc + 12);
+        qToLittleEndian<quint32>(module.addressRVA, desc + 16);
+    }
+    const quint64 ordinalFlag = isPlus ? Q_UINT64_C(0x8000000000000000) : Q_UINT64_C(0x80000000);
+    quint32 thunkPos = 0, hintNamePos = hintNameOffset, moduleNamePos = moduleNameOffset;
+    foreach (const ImportGroup &group, groups) {
+        qToLittleEndian<quint32>(base + iltOffset + thunkPos, desc);
+        qToLittleEndian<quint32>(base + moduleNamePos, desc + 12);
+        qToLittleEndian<quint32>(base + iatOffset + thunkPos, desc + 16);
+        desc += descriptorSize;
+        memcpy(data + moduleNamePos, group.name.constData(), static_cast<size_t>(group.name.size()));
+        moduleNamePos += static_cast<quint32>(group.name.size()) + 1;
+        foreach (int index, group.functions) {
+            Function &function = m_functions[index];
+            quint64 thunk;
+            if (function.name.isEmpty())
+                thunk = ordinalFlag | function.ordinal;
+            else {
+                thunk = base + hintNamePos;
+                qToLittleEndian<quint16>(function.hint, data + hintNamePos);
+                memcpy(data + hintNamePos + 2, function.name.constData(), static_cast<size_t>(function.name.size()));
+                hintNamePos += QExe::alignForward(static_cast<quint32>(function.name.size()) + 3, 2u);
+            }
+            // until the loader fills it in, the address table is a copy of the lookup table
+            writeThunk(data + iatOffset + thunkPos, thunk);
+            writeThunk(data + iltOffset + thunkPos, thunk);
+            function.addressRVA = base + iatOffset + thunkPos;
+            thunkPos += thunkSize;
+        }
+        // each table ends with a zero thunk
+        thunkPos += thunkSize;
+    }
+
+    DataDirectoryPtr importDir = optHead->dataDirectories[QExeOptionalHeader::ImportTable];
+    importDir->first = base;
+    importDir->second = descSize;
+    // the bound import directory describes the old descriptors, so binding is dropped and the loader resolves everything
+    if (optHead->dataDirectories.size() > QExeOptionalHeader::BoundImportTable) {
+        DataDirectoryPtr boundDir = optHead->dataDirectories[QExeOptionalHeader::BoundImportTable];
+        boundDir->first = 0;
+        boundDir->second = 0;
+    }
+    if (optHead->dataDirectories.size() > QExeOptionalHeader::ImportAddrTable) {
+        DataDirectoryPtr iatDir = optHead->dataDirectories[QExeOptionalHeader::ImportAddrTable];
+        // the loader makes this range writable while binding, stretching it over other sections would change their protection
+        if (iatDir->first == 0) {
+            iatDir->first = base + iatOffset;
+            iatDir->second = thunkCount * thunkSize;
+        }
+    }
+    m_section = newSec;
+    return true;
+}
+
+quint32 QExeImportBuilder::addressRVA(int index) const
+{
+    return m_functions[index].addressRVA;
+}
+
+QExeSectionPtr QExeImportBuilder::section() const
+{
+    return m_section;
+}
+
+int QExeImportBuilder::add(const Function &function, const QByteArray &key)
+{
+    auto it = m_index.constFind(key);
+    if (it != m_index.constEnd())
+        return it.value();
+    m_index.insert(key, m_functions.size());
+    m_functions += function;
+    return m_functions.size() - 1;
+}
+
+QByteArray QExeImportBuilder::moduleKey(const QString &name)
+{
+    QByteArray key = name.toLatin1().toLower();
+    if (!key.contains('.'))
+        key += ".dll";
+    return key;
+}
@@ -0,0 +1,55 @@
+#ifndef QEXEIMPORTBUILDER_H
+#define QEXEIMPORTBUILDER_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+#include "qexesection.h"
+
+class QExe;
+
+// adds imports by laying out a new import directory in a section of its own
+// the existing descriptors are copied over as they are, so their lookup and address tables (and every reference to
+// their IAT slots) stay where they were; the added modules get their descriptors, lookup tables, address tables and
+// hint/name entries after them, all in one buffer sized up front
+// functions added to a module that's already imported get a descriptor of their own, since its IAT can't grow in place
+class QEXE_EXPORT QExeImportBuilder
+{
+public:
+    QExeImportBuilder();
+    // both return an index for addressRVA()
+    int addFunction(const QString &module, const QString &function, quint16 hint = 0);
+    int addFunction(const QString &module, quint16 ordinal);
+    int functionCount() const;
+    void clear();
+
+    // adds the new section (unless everything is imported already) and points the ImportTable data directory at it
+    // the ImportAddrTable data directory is only set if the image didn't have one, the new section is writable anyway
+    // the BoundImportTable data directory is cleared, since it only describes the old descriptors
+    // can be called again (with another section name) after adding more functions, slots built before are reused
+    bool build(QExe &exeDat, const QLatin1String &secName = QLatin1String(".idata2"), QExeErrorInfo *errinfo = nullptr);
+    // IAT slot of an added function, 0 until build() succeeds
+    quint32 addressRVA(int index) const;
+    // section added by the last build(), if any
+    QExeSectionPtr section() const;
+private:
+    struct Function {
+        QString module;
+        QByteArray name; // empty if imported by ordinal
+        quint16 hint;
+        quint16 ordinal;
+        quint32 addressRVA;
+    };
+    int add(const Function &function, const QByteArray &key);
+    static QByteArray moduleKey(const QString &name);
+
+    QVector<Function> m_functions;
+    QHash<QByteArray, int> m_index; // lower-cased "module!function" or "module#ordinal" => function
+    QExeSectionPtr m_section;
+};
+
+#endif // QEXEIMPORTBUILDER_H
@@ -0,0 +1,194 @@
+#include "qexeimporttable.h"
+
+#include "qexe.h"
+
+// IMAGE_THUNK_DATA32/64: the top bit marks an ordinal import
+template<typename Thunk>
+struct ThunkTraits;
+
+template<>
+struct ThunkTraits<quint32> {
+    static const quint32 ordinalFlag = 0x80000000u;
+};
+
+template<>
+struct ThunkTraits<quint64> {
+    static const quint64 ordinalFlag = Q_UINT64_C(0x8000000000000000);
+};
+
+static const quint32 descriptorSize = 20;
+
+QExeImportTable::QExeImportTable()
+{
+}
+
+bool QExeImportTable::read(const QExe &exeDat, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    clear();
+    if (optHead->dataDirectories.size() <= QExeOptionalHeader::ImportTable)
+        return true;
+    quint32 rva = optHead->dataDirectories[QExeOptionalHeader::ImportTable]->first;
+    if (rva == 0)
+        return true;
+    return read(QExeRVAResolver(*exeDat.sectionManager()), rva, optHead->isPlus, errinfo);
+}
+
+bool QExeImportTable::read(const QExeRVAResolver &resolver, quint32 rva, bool isPlus, QExeErrorInfo *errinfo)
+{
+    clear();
+    m_resolver = resolver;
+    for (;; rva += descriptorSize) {
+        const char *desc = m_resolver.pointer(rva, descriptorSize);
+        if (desc == nullptr) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+                errinfo->details += rva;
+            }
+            return false;
+        }
+        Module module;
+        module.lookupRVA = qFromLittleEndian<quint32>(desc);
+        module.timestamp = qFromLittleEndian<quint32>(desc + 4);
+        module.forwarderChain = qFromLittleEndian<quint32>(desc + 8);
+        module.nameRVA = qFromLittleEndian<quint32>(desc + 12);
+        module.addressRVA = qFromLittleEndian<quint32>(desc + 16);
+        // the table ends with an all-zero descriptor
+        if (module.nameRVA == 0 && module.addressRVA == 0)
+            break;
+        module.name = m_resolver.string(module.nameRVA);
+        if (module.name.data() == nullptr) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+                errinfo->details += module.nameRVA;
+            }
+            return false;
+        }
+        if (!(isPlus ? readThunks<quint64>(module, errinfo) : readThunks<quint32>(module, errinfo)))
+            return false;
+        const int index = m_modules.size();
+        // a module may be imported through several descriptors, their functions are all indexed under the first one
+        const QByteArray key = moduleKey(module.name);
+        const int first = m_moduleIndex.value(key, index);
+        if (first == index)
+            m_moduleIndex.insert(key, index);
+        for (int i = 0; i < module.functions.size(); i++) {
+            const Function &function = module.functions[i];
+            if (function.byOrdinal) {
+                if (!m_ordinalIndex.contains(qMakePair(first, function.ordinal)))
+                    m_ordinalIndex.insert(qMakePair(first, function.ordinal), qMakePair(index, i));
+            } else if (!m_nameIndex.contains(qMakePair(first, function.name)))
+                m_nameIndex.insert(qMakePair(first, function.name), qMakePair(index, i));
+        }
+        m_modules += module;
+    }
+    return true;
+}
+
+void QExeImportTable::clear()
+{
+    m_resolver = QExeRVAResolver();
+    m_modules.clear();
+    m_moduleIndex.clear();
+    m_nameIndex.clear();
+    m_ordinalIndex.clear();
+}
+
+int QExeImportTable::moduleCount() const
+{
+    return m_modules.size();
+}
+
+const QExeImportTable::Module &QExeImportTable::moduleAt(int index) const
+{
+    return m_modules[index];
+}
+
+const QExeImportTable::Module *QExeImportTable::module(const QString &name) const
+{
+    int index = moduleIndex(name);
+    return index < 0 ? nullptr : &m_modules[index];
+}
+
+const QExeImportTable::Function *QExeImportTable::function(const QString &module, const QString &function) const
+{
+    int index = moduleIndex(module);
+    if (index < 0)
+        return nullptr;
+    const QByteArray name = function.toLatin1();
+    auto it = m_nameIndex.constFind(qMakePair(index, QLatin1String(name.constData(), name.size())));
+    return it == m_nameIndex.constEnd() ? nullptr : &m_modules[it.value().first].functions[it.value().second];
+}
+
+const QExeImportTable::Function *QExeImportTable::function(const QString &module, quint16 ordinal) const
+{
+    int index = moduleIndex(module);
+    if (index < 0)
+        return nullptr;
+    auto it = m_ordinalIndex.constFind(qMakePair(index, ordinal));
+    return it == m_ordinalIndex.constEnd() ? nullptr : &m_modules[it.value().first].functions[it.value().second];
+}
+
+bool QExeImportTable::imports(const QString &module, const QString &function) const
+{
+    return this->function(module, function) != nullptr;
+}
+
+bool QExeImportTable::imports(const QString &module, quint16 ordinal) const
+{
+    return function(module, ordinal) != nullptr;
+}
+
+template<typename Thunk>
+bool QExeImportTable::readThunks(Module &module, QExeErrorInfo *errinfo)
+{
+    // bound images may not have a lookup table, but then the address table still holds the original thunks
+    quint32 rva = module.lookupRVA != 0 ? module.lookupRVA : module.addressRVA;
+    quint32 addressRVA = module.addressRVA;
+    for (;; rva += sizeof(Thunk), addressRVA += sizeof(Thunk)) {
+        Thunk thunk;
+        if (!m_resolver.read(rva, &thunk)) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+                errinfo->details += rva;
+            }
+            return false;
+        }
+        if (thunk == 0)
+            break;
+        Function function;
+        function.addressRVA = addressRVA;
+        function.byOrdinal = (thunk & ThunkTraits<Thunk>::ordinalFlag) != 0;
+        function.hint = 0;
+        function.ordinal = 0;
+        if (function.byOrdinal)
+            function.ordinal = static_cast<quint16>(thunk & 0xFFFF);
+        else {
+            // hint/name entry: 16-bit hint, then the NUL-terminated name
+            quint32 hintRVA = static_cast<quint32>(thunk & 0x7FFFFFFF);
+            function.name = m_resolver.string(hintRVA + 2);
+            if (!m_resolver.read(hintRVA, &function.hint) || function.name.data() == nullptr) {
+                if (errinfo != nullptr) {
+                    errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+                    errinfo->details += hintRVA;
+                }
+                return false;
+            }
+        }
+        module.functions += function;
+    }
+    return true;
+}
+
+int QExeImportTable::moduleIndex(const QString &name) const
+{
+    auto it = m_moduleIndex.constFind(moduleKey(name));
+    if (it == m_moduleIndex.constEnd() && !name.contains(QLatin1Char('.')))
+        it = m_moduleIndex.constFind(moduleKey(name + QLatin1String(".dll")));
+    return it == m_moduleIndex.constEnd() ? -1 : it.value();
+}
+
+QByteArray QExeImportTable::moduleKey(const QString &name)
+{
+    return name.toLatin1().toLower();
+}
@@ -0,0 +1,65 @@
+#ifndef QEXEIMPORTTABLE_H
+#define QEXEIMPORTTABLE_H
+
+#include "QExe_global.h"
+
+#include <QHash>
+#include <QLatin1String>
+#include <QPair>
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+#include "qexervaresolver.h"
+
+class QExe;
+
+// parsed ImportTable data directory
+// names point straight into the section data held by the table's QExeRVAResolver, nothing is copied
+class QEXE_EXPORT QExeImportTable
+{
+public:
+    struct Function {
+        QLatin1String name; // null if imported by ordinal
+        quint16 hint;
+        quint16 ordinal; // only valid if imported by ordinal
+        bool byOrdinal;
+        quint32 addressRVA; // IAT slot
+    };
+    struct Module {
+        QLatin1String name;
+        quint32 nameRVA;
+        quint32 timestamp;
+        quint32 forwarderChain;
+        quint32 lookupRVA;
+        quint32 addressRVA;
+        QVector<Function> functions;
+    };
+
+    QExeImportTable();
+    bool read(const QExe &exeDat, QExeErrorInfo *errinfo = nullptr);
+    bool read(const QExeRVAResolver &resolver, quint32 rva, bool isPlus, QExeErrorInfo *errinfo = nullptr);
+    void clear();
+
+    int moduleCount() const;
+    const Module &moduleAt(int index) const;
+    // module names are case-insensitive, and ".dll" may be left out (e.g. "kernel32")
+    // a module imported through several descriptors is returned as its first one, functions are looked up in all of them
+    const Module *module(const QString &name) const;
+    const Function *function(const QString &module, const QString &function) const;
+    const Function *function(const QString &module, quint16 ordinal) const;
+    bool imports(const QString &module, const QString &function) const;
+    bool imports(const QString &module, quint16 ordinal) const;
+private:
+    template<typename Thunk>
+    bool readThunks(Module &module, QExeErrorInfo *errinfo);
+    int moduleIndex(const QString &name) const;
+    static QByteArray moduleKey(const QString &name);
+
+    QExeRVAResolver m_resolver;
+    QVector<Module> m_modules;
+    QHash<QByteArray, int> m_moduleIndex; // lower-cased module name => first module with that name
+    QHash<QPair<int, QLatin1String>, QPair<int, int>> m_nameIndex; // (first module, function name) => (module, function)
+    QHash<QPair<int, quint16>, QPair<int, int>> m_ordinalIndex; // (first module, ordinal) => (module, function)
+};
+
+#endif // QEXEIMPORTTABLE_H
@@ -11,7 +11,8 @@
 quint32 QExeOptionalHeader::size() const
 {
     // 0x1C (standard) + 0x44 (Windows specific) + dataDirectories.size() * 8
-    return 0x60 + static_cast<quint32>(dataDirectories.size()) * 8;
+    // PE32+ drops BaseOfData, but widens ImageBase and the stack/heap sizes, for 0x10 more bytes
+    return (isPlus ? 0x70 : 0x60) + static_cast<quint32>(dataDirectories.size()) * 8;
 }
 
 QExeOptionalHeader::QExeOptionalHeader(QExe *exeDat, QObject *parent) : QObject(parent)
@@ -0,0 +1,130 @@
+#include "qexeoverlay.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+static const qint64 copyChunkSize = 1024 * 1024;
+
+qint64 QExeOverlay::size() const
+{
+    return m_size;
+}
+
+bool QExeOverlay::isEmpty() const
+{
+    return m_size == 0;
+}
+
+bool QExeOverlay::isLoaded() const
+{
+    return m_fileName.isEmpty();
+}
+
+qint64 QExeOverlay::filePos() const
+{
+    return m_filePos;
+}
+
+QString QExeOverlay::sourceFileName() const
+{
+    return m_fileName;
+}
+
+QByteArray QExeOverlay::data() const
+{
+    if (isLoaded())
+        return m_data;
+    QByteArray ret;
+    ret.reserve(static_cast<int>(m_size));
+    if (!read(0, m_size, [&ret](const char *data, qint64 len) {
+        ret.append(data, static_cast<int>(len));
+        return true;
+    }))
+        return QByteArray();
+    return ret;
+}
+
+void QExeOverlay::setData(const QByteArray &data)
+{
+    m_data = data;
+    m_fileName.clear();
+    m_srcOffset = 0;
+    m_size = data.size();
+}
+
+void QExeOverlay::setSource(const QString &fileName, qint64 offset, qint64 size)
+{
+    m_data.clear();
+    m_fileName = fileName;
+    m_srcOffset = offset;
+    m_size = size;
+}
+
+bool QExeOverlay::load(QExeErrorInfo *errinfo)
+{
+    if (isLoaded())
+        return true;
+    QByteArray data = this->data();
+    if (data.size() != m_size) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadOverlay_SourceUnavailable;
+            errinfo->details += m_fileName;
+        }
+        return false;
+    }
+    setData(data);
+    return true;
+}
+
+bool QExeOverlay::sourceAvailable() const
+{
+    if (isLoaded())
+        return true;
+    QFileInfo info(m_fileName);
+    return info.exists() && info.size() >= m_srcOffset + m_size;
+}
+
+void QExeOverlay::clear()
+{
+    setData(QByteArray());
+    m_filePos = 0;
+}
+
+QExeOverlay::QExeOverlay(QExe *exeDat, QObject *parent) : QObject(parent)
+{
+    m_exeDat = exeDat;
+    m_srcOffset = 0;
+    m_size = 0;
+    m_filePos = 0;
+}
+
+bool QExeOverlay::read(qint64 pos, qint64 len, const std::function<bool(const char *, qint64)> &consumer) const
+{
+    if (pos < 0 || len < 0 || pos + len > m_size)
+        return false;
+    if (len == 0)
+        return true;
+    if (isLoaded())
+        return consumer(m_data.constData() + pos, len);
+    QFile src(m_fileName);
+    // make sure the source is still (at least) as big as it was when read
+    if (!src.open(QFile::ReadOnly) || src.size() < m_srcOffset + m_size)
+        return false;
+    uchar *mapped = src.map(m_srcOffset + pos, len);
+    if (mapped != nullptr) {
+        bool ok = consumer(reinterpret_cast<const char *>(mapped), len);
+        src.unmap(mapped);
+        return ok;
+    }
+    // can't be mapped (e.g. not enough address space), copy it in chunks instead
+    if (!src.seek(m_srcOffset + pos))
+        return false;
+    QByteArray buf(static_cast<int>(qMin(len, copyChunkSize)), Qt::Uninitialized);
+    while (len > 0) {
+        qint64 chunk = src.read(buf.data(), qMin<qint64>(len, buf.size()));
+        if (chunk <= 0 || !consumer(buf.constData(), chunk))
+            return false;
+        len -= chunk;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef QEXEOVERLAY_H
+#define QEXEOVERLAY_H
+
+#include <QObject>
+
+#include <functional>
+
+#include "QExe_global.h"
+#include "qexeerrorinfo.h"
+
+class QExe;
+
+// everything after the last section's raw data (installer payloads, the Authenticode certificate table, etc.)
+// small overlays are loaded on read; of bigger ones read from a file, only the file name and range are kept: the
+// bytes are streamed (mapped if possible) from the source on write, so the source file must stay unchanged until
+// then, or be load()ed first (writing over the source itself works only if it's opened without truncating it)
+class QEXE_EXPORT QExeOverlay : public QObject
+{
+    Q_OBJECT
+
+public:
+    qint64 size() const;
+    bool isEmpty() const;
+    bool isLoaded() const;
+    qint64 filePos() const;
+    QString sourceFileName() const;
+    QByteArray data() const;
+    void setData(const QByteArray &data);
+    void setSource(const QString &fileName, qint64 offset, qint64 size);
+    bool load(QExeErrorInfo *errinfo = nullptr);
+    // whether the source file (if any) still holds the overlay's range
+    bool sourceAvailable() const;
+    void clear();
+private:
+    friend class QExe;
+
+    explicit QExeOverlay(QExe *exeDat, QObject *parent = nullptr);
+    QExe *m_exeDat;
+    QByteArray m_data;
+    QString m_fileName; // empty if m_data holds the overlay
+    qint64 m_srcOffset;
+    qint64 m_size;
+    qint64 m_filePos; // position in the image, as read or as last written
+    // feeds [pos, pos + len) to consumer in one or more pieces, stops if it returns false
+    bool read(qint64 pos, qint64 len, const std::function<bool(const char *, qint64)> &consumer) const;
+};
+
+#endif // QEXEOVERLAY_H
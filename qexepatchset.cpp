@@ -0,0 +1,189 @@
+#include "qexepatchset.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "qexe.h"
+#include "qexeconcurrent_p.h"
+
+// checking and applying is spread across sections once there are this many patches
+static const int patchParallelThreshold = 4096;
+
+struct QExePatchSet::Group {
+    QExeSection *section;
+    QVector<int> patches; // sorted by RVA
+};
+
+QExePatchSet::QExePatchSet()
+{
+}
+
+bool QExePatchSet::add(quint32 rva, const QByteArray &expected, const QByteArray &replacement)
+{
+    if (!expected.isEmpty() && expected.size() != replacement.size())
+        return false;
+    Patch patch;
+    patch.rva = rva;
+    patch.expected = expected;
+    patch.replacement = replacement;
+    m_patches += patch;
+    return true;
+}
+
+int QExePatchSet::count() const
+{
+    return m_patches.size();
+}
+
+const QExePatchSet::Patch &QExePatchSet::at(int index) const
+{
+    return m_patches[index];
+}
+
+void QExePatchSet::clear()
+{
+    m_patches.clear();
+    m_replaced.clear();
+}
+
+bool QExePatchSet::validate(const QExe &exeDat, QVector<Failure> *failures) const
+{
+    QVector<Group> groups;
+    return plan(exeDat, &groups, failures);
+}
+
+bool QExePatchSet::apply(QExe &exeDat, QExeErrorInfo *errinfo, QVector<Failure> *failures)
+{
+    QVector<Group> groups;
+    QVector<Failure> found;
+    if (!plan(exeDat, &groups, &found)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadPatch_ValidationFailed;
+            errinfo->details += m_patches[found.first().patch].rva;
+            errinfo->details += static_cast<int>(found.first().problem);
+        }
+        if (failures != nullptr)
+            *failures = found;
+        return false;
+    }
+    if (failures != nullptr)
+        failures->clear();
+    m_replaced = QVector<QByteArray>(m_patches.size());
+    // detach everything up front, the workers only write through plain pointers
+    QVector<char *> sectionData(groups.size());
+    for (int i = 0; i < groups.size(); i++)
+        sectionData[i] = groups[i].section->rawData.data();
+    QByteArray *replaced = m_replaced.data();
+    const Patch *patches = m_patches.constData();
+    QExeConcurrent::forEachIndex(groups.size(), m_patches.size() >= patchParallelThreshold, [&groups, &sectionData, replaced, patches](int i) {
+        const Group &group = groups[i];
+        foreach (int index, group.patches) {
+            const Patch &patch = patches[index];
+            char *dst = sectionData[i] + (patch.rva - group.section->virtualAddr);
+            replaced[index] = QByteArray(dst, patch.replacement.size());
+            memcpy(dst, patch.replacement.constData(), static_cast<size_t>(patch.replacement.size()));
+        }
+    });
+    return true;
+}
+
+QExePatchSet QExePatchSet::inverted() const
+{
+    QExePatchSet ret;
+    ret.m_patches.reserve(m_patches.size());
+    for (int i = 0; i < m_patches.size(); i++) {
+        const Patch &patch = m_patches[i];
+        Patch inverse;
+        inverse.rva = patch.rva;
+        inverse.replacement = patch.expected.isEmpty() ? m_replaced.value(i) : patch.expected;
+        // patches that never expected anything and weren't applied can't be undone, so they become no-ops
+        if (inverse.replacement.size() == patch.replacement.size())
+            inverse.expected = patch.replacement;
+        ret.m_patches += inverse;
+    }
+    return ret;
+}
+
+bool QExePatchSet::revert(QExe &exeDat, QExeErrorInfo *errinfo, QVector<Failure> *failures) const
+{
+    QExePatchSet inverse = inverted();
+    return inverse.apply(exeDat, errinfo, failures);
+}
+
+bool QExePatchSet::plan(const QExe &exeDat, QVector<Group> *groups, QVector<Failure> *failures) const
+{
+    QVector<int> order(m_patches.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](int index1, int index2) {
+        return m_patches[index1].rva < m_patches[index2].rva;
+    });
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    QVector<QExeSectionPtr> sections;
+    for (int i = 0; i < secMgr->sectionCount(); i++)
+        sections += secMgr->sectionAt(i);
+    std::sort(sections.begin(), sections.end(), [](const QExeSectionPtr &sec1, const QExeSectionPtr &sec2) {
+        return sec1->virtualAddr < sec2->virtualAddr;
+    });
+    // patches and sections are both sorted, so they can be matched up in one pass
+    QVector<Failure> found;
+    groups->clear();
+    int secIndex = 0;
+    quint64 prevEnd = 0;
+    foreach (int index, order) {
+        const Patch &patch = m_patches[index];
+        const quint64 end = static_cast<quint64>(patch.rva) + patch.replacement.size();
+        Failure failure = { index, NoProblem };
+        if (patch.rva < prevEnd && !patch.replacement.isEmpty())
+            failure.problem = Overlap;
+        else {
+            prevEnd = qMax(prevEnd, end);
+            while (secIndex < sections.size() && static_cast<quint64>(sections[secIndex]->virtualAddr)
+                   + qMax(sections[secIndex]->virtualSize, static_cast<quint32>(sections[secIndex]->rawData.size())) <= patch.rva)
+                secIndex++;
+            if (secIndex >= sections.size() || patch.rva < sections[secIndex]->virtualAddr)
+                failure.problem = Unmapped;
+            else {
+                const QExeSectionPtr &section = sections[secIndex];
+                if (end > static_cast<quint64>(section->virtualAddr) + qMax(section->virtualSize, static_cast<quint32>(section->rawData.size())))
+                    failure.problem = SpansSections;
+                else if (end > static_cast<quint64>(section->virtualAddr) + section->rawData.size())
+                    failure.problem = VirtualOnly;
+            }
+        }
+        if (failure.problem != NoProblem) {
+            found += failure;
+            continue;
+        }
+        if (groups->isEmpty() || groups->last().section != sections[secIndex].data()) {
+            Group group;
+            group.section = sections[secIndex].data();
+            *groups += group;
+        }
+        groups->last().patches += index;
+    }
+    // then check the expected bytes, a section at a time
+    QVector<QVector<Failure>> mismatches(groups->size());
+    const Patch *patches = m_patches.constData();
+    QExeConcurrent::forEachIndex(groups->size(), m_patches.size() >= patchParallelThreshold, [groups, &mismatches, patches](int i) {
+        const Group &group = groups->at(i);
+        const char *data = group.section->rawData.constData();
+        foreach (int index, group.patches) {
+            const Patch &patch = patches[index];
+            if (!patch.expected.isEmpty() && memcmp(data + (patch.rva - group.section->virtualAddr), patch.expected.constData(),
+                                                    static_cast<size_t>(patch.expected.size())) != 0) {
+                Failure failure = { index, Mismatch };
+                mismatches[i] += failure;
+            }
+        }
+    });
+    foreach (const QVector<Failure> &groupMismatches, mismatches)
+        found += groupMismatches;
+    std::sort(found.begin(), found.end(), [patches](const Failure &failure1, const Failure &failure2) {
+        return patches[failure1.patch].rva != patches[failure2.patch].rva ? patches[failure1.patch].rva < patches[failure2.patch].rva
+                                                                          : failure1.patch < failure2.patch;
+    });
+    if (failures != nullptr)
+        *failures = found;
+    return found.isEmpty();
+}
@@ -0,0 +1,59 @@
+#ifndef QEXEPATCHSET_H
+#define QEXEPATCHSET_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+
+class QExe;
+
+// list of byte patches to section data, applied all at once
+// patches are sorted by RVA and matched up with the sections in a single merge pass, then every expected byte is
+// checked before anything is written, so apply() either changes nothing or applies everything
+class QEXE_EXPORT QExePatchSet
+{
+public:
+    struct Patch {
+        quint32 rva;
+        QByteArray expected; // empty if the current bytes don't matter
+        QByteArray replacement;
+    };
+    enum Problem : quint8 {
+        NoProblem,
+        Unmapped, // not inside any section
+        SpansSections, // runs past the end of its section
+        VirtualOnly, // (partly) in the section's zero-filled tail, past its raw data
+        Mismatch, // current bytes differ from the expected ones
+        Overlap // overlaps another patch in the set
+    };
+    struct Failure {
+        int patch; // index into the set
+        Problem problem;
+    };
+
+    QExePatchSet();
+    // returns false (and adds nothing) if expected is given but isn't the same size as replacement
+    bool add(quint32 rva, const QByteArray &expected, const QByteArray &replacement);
+    int count() const;
+    const Patch &at(int index) const;
+    void clear();
+
+    // failures are sorted by RVA
+    bool validate(const QExe &exeDat, QVector<Failure> *failures = nullptr) const;
+    bool apply(QExe &exeDat, QExeErrorInfo *errinfo = nullptr, QVector<Failure> *failures = nullptr);
+    // swaps the expected and replacement bytes of every patch, using the bytes replaced by the last apply() where
+    // nothing was expected; applying the result undoes this set
+    QExePatchSet inverted() const;
+    bool revert(QExe &exeDat, QExeErrorInfo *errinfo = nullptr, QVector<Failure> *failures = nullptr) const;
+private:
+    struct Group; // patches that land in the same section
+    bool plan(const QExe &exeDat, QVector<Group> *groups, QVector<Failure> *failures) const;
+
+    QVector<Patch> m_patches;
+    QVector<QByteArray> m_replaced; // bytes overwritten by the last apply()
+};
+
+#endif // QEXEPATCHSET_H
@@ -0,0 +1,225 @@
+#include "qexereloctable.h"
+
+#include <algorithm>
+
+#include "qexe.h"
+#include "qexeconcurrent_p.h"
+
+// images with fewer fixups than this are rebased on the calling thread
+static const int rebaseParallelThreshold = 0x10000;
+
+// number of bytes a fixup touches, or 0 if the type isn't supported
+static quint32 fixupWidth(QExeRelocTable::Type type)
+{
+    switch (type) {
+    case QExeRelocTable::High:
+    case QExeRelocTable::Low:
+    case QExeRelocTable::HighAdj:
+        return 2;
+    case QExeRelocTable::HighLow:
+        return 4;
+    case QExeRelocTable::Dir64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+QExeRelocTable::QExeRelocTable()
+{
+    m_fixupCount = 0;
+}
+
+bool QExeRelocTable::read(const QExe &exeDat, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    m_blocks.clear();
+    m_fixupCount = 0;
+    if (optHead->dataDirectories.size() <= QExeOptionalHeader::BaseRelocationTable)
+        return true;
+    DataDirectoryPtr dir = optHead->dataDirectories[QExeOptionalHeader::BaseRelocationTable];
+    if (dir->first == 0 || dir->second == 0)
+        return true;
+    return read(QExeRVAResolver(*exeDat.sectionManager()), dir->first, dir->second, errinfo);
+}
+
+bool QExeRelocTable::read(const QExeRVAResolver &resolver, quint32 rva, quint32 size, QExeErrorInfo *errinfo)
+{
+    m_resolver = resolver;
+    m_blocks.clear();
+    m_fixupCount = 0;
+    const char *src = m_resolver.pointer(rva, size);
+    if (src == nullptr) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    quint32 pos = 0;
+    while (pos + 8 <= size) {
+        Block block;
+        block.pageRVA = qFromLittleEndian<quint32>(src + pos);
+        quint32 blockSize = qFromLittleEndian<quint32>(src + pos + 4);
+        if (blockSize < 8 || blockSize > size - pos) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+                errinfo->details += rva + pos;
+            }
+            return false;
+        }
+        block.count = static_cast<int>((blockSize - 8) / 2);
+        block.entries = src + pos + 8;
+        for (int i = 0; i < block.count; i++) {
+            if (entryType(entryAt(block, i)) != Absolute)
+                m_fixupCount++;
+        }
+        m_blocks += block;
+        pos += blockSize;
+    }
+    return true;
+}
+
+int QExeRelocTable::blockCount() const
+{
+    return m_blocks.size();
+}
+
+const QExeRelocTable::Block &QExeRelocTable::blockAt(int index) const
+{
+    return m_blocks[index];
+}
+
+int QExeRelocTable::fixupCount() const
+{
+    return m_fixupCount;
+}
+
+quint16 QExeRelocTable::entryAt(const Block &block, int index)
+{
+    return qFromLittleEndian<quint16>(block.entries + index * 2);
+}
+
+QExeRelocTable::Type QExeRelocTable::entryType(quint16 entry)
+{
+    return static_cast<Type>(entry >> 12);
+}
+
+quint16 QExeRelocTable::entryOffset(quint16 entry)
+{
+    return entry & 0xFFF;
+}
+
+bool QExeRelocTable::rebase(QExe &exeDat, quint64 newBase, bool stripRelocs, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat.optionalHeader();
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    // images are mapped on 64K boundaries
+    if ((newBase & 0xFFFF) != 0 || (!optHead->isPlus && newBase > 0xFFFFFFFFu)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadRebase_InvalidBase;
+            errinfo->details += newBase;
+        }
+        return false;
+    }
+    QExeRelocTable relocs;
+    if (!relocs.read(exeDat, errinfo))
+        return false;
+    const quint64 delta = newBase - optHead->imageBase;
+    if (delta != 0 && relocs.blockCount() > 0) {
+        QVector<QExeSectionPtr> sections;
+        for (int i = 0; i < secMgr->sectionCount(); i++)
+            sections += secMgr->sectionAt(i);
+        std::sort(sections.begin(), sections.end(), [](const QExeSectionPtr &sec1, const QExeSectionPtr &sec2) {
+            return sec1->virtualAddr < sec2->virtualAddr;
+        });
+        const bool parallel = relocs.fixupCount() >= rebaseParallelThreshold;
+        // resolve each page to its section once, and check every fixup before touching anything
+        QVector<int> blockSections(relocs.blockCount(), -1);
+        QExeConcurrent::forEachIndex(relocs.blockCount(), parallel, [&relocs, &sections, &blockSections](int i) {
+            const Block &block = relocs.m_blocks[i];
+            auto it = std::upper_bound(sections.constBegin(), sections.constEnd(), block.pageRVA, [](quint32 rva, const QExeSectionPtr &sec) {
+                return rva < sec->virtualAddr;
+            });
+            if (it == sections.constBegin())
+                return;
+            --it;
+            const quint32 start = block.pageRVA - (*it)->virtualAddr;
+            const quint32 rawSize = static_cast<quint32>((*it)->rawData.size());
+            for (int j = 0; j < block.count; j++) {
+                quint16 entry = entryAt(block, j);
+                Type type = entryType(entry);
+                if (type == Absolute)
+                    continue;
+                quint32 width = fixupWidth(type);
+                if (width == 0 || static_cast<quint64>(start) + entryOffset(entry) + width > rawSize)
+                    return;
+                if (type == HighAdj && ++j >= block.count)
+                    return;
+            }
+            blockSections[i] = static_cast<int>(it - sections.constBegin());
+        });
+        for (int i = 0; i < blockSections.size(); i++) {
+            if (blockSections[i] < 0) {
+                if (errinfo != nullptr) {
+                    errinfo->errorID = QExeErrorInfo::BadRebase_FixupOutOfRange;
+                    errinfo->details += relocs.m_blocks[i].pageRVA;
+                }
+                return false;
+            }
+        }
+        // detach everything up front, the workers only write through plain pointers
+        QVector<char *> sectionData(sections.size(), nullptr);
+        foreach (int index, blockSections) {
+            if (sectionData[index] == nullptr)
+                sectionData[index] = sections[index]->rawData.data();
+        }
+        // every block is a separate page, so they can be patched independently
+        QExeConcurrent::forEachIndex(relocs.blockCount(), parallel, [&relocs, &sections, &blockSections, &sectionData, delta](int i) {
+            const Block &block = relocs.m_blocks[i];
+            const int index = blockSections[i];
+            char *page = sectionData[index] + (block.pageRVA - sections[index]->virtualAddr);
+            for (int j = 0; j < block.count; j++) {
+                quint16 entry = entryAt(block, j);
+                char *dst = page + entryOffset(entry);
+                switch (entryType(entry)) {
+                case High:
+                    qToLittleEndian<quint16>(static_cast<quint16>(((static_cast<quint32>(qFromLittleEndian<quint16>(dst)) << 16) + static_cast<quint32>(delta)) >> 16), dst);
+                    break;
+                case Low:
+                    qToLittleEndian<quint16>(static_cast<quint16>(qFromLittleEndian<quint16>(dst) + static_cast<quint16>(delta)), dst);
+                    break;
+                case HighLow:
+                    qToLittleEndian<quint32>(qFromLittleEndian<quint32>(dst) + static_cast<quint32>(delta), dst);
+                    break;
+                case HighAdj: {
+                    // the next entry is the low half of the full value, for rounding
+                    qint16 low = static_cast<qint16>(entryAt(block, ++j));
+                    quint32 value = (static_cast<quint32>(qFromLittleEndian<quint16>(dst)) << 16) + static_cast<quint32>(static_cast<qint32>(low));
+                    value += static_cast<quint32>(delta) + 0x8000;
+                    qToLittleEndian<quint16>(static_cast<quint16>(value >> 16), dst);
+                    break;
+                }
+                case Dir64:
+                    qToLittleEndian<quint64>(qFromLittleEndian<quint64>(dst) + delta, dst);
+                    break;
+                default:
+                    break;
+                }
+            }
+        });
+    }
+    optHead->imageBase = newBase;
+    if (stripRelocs && optHead->dataDirectories.size() > QExeOptionalHeader::BaseRelocationTable) {
+        DataDirectoryPtr dir = optHead->dataDirectories[QExeOptionalHeader::BaseRelocationTable];
+        // the directory is pointed at any section named .reloc when writing, so a dedicated section has to go as well
+        QExeSectionPtr relocSec = secMgr->sectionWithName(QLatin1String(".reloc"));
+        if (!relocSec.isNull() && dir->first >= relocSec->virtualAddr && dir->first - relocSec->virtualAddr < relocSec->virtualSize)
+            secMgr->removeSection(relocSec);
+        dir->first = 0;
+        dir->second = 0;
+        exeDat.coffHeader()->characteristics.setFlag(QExeCOFFHeader::RelocsStripped);
+        optHead->dllCharacteristics.setFlag(QExeOptionalHeader::DynamicBase, false);
+    }
+    return true;
+}
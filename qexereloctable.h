@@ -0,0 +1,52 @@
+#ifndef QEXERELOCTABLE_H
+#define QEXERELOCTABLE_H
+
+#include "QExe_global.h"
+
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+#include "qexervaresolver.h"
+
+class QExe;
+
+// parsed BaseRelocationTable data directory
+// blocks point straight into the section data held by the table's QExeRVAResolver
+class QEXE_EXPORT QExeRelocTable
+{
+public:
+    enum Type : quint8 {
+        Absolute = 0, // padding, ignored
+        High = 1,
+        Low = 2,
+        HighLow = 3,
+        HighAdj = 4, // takes up two entries, the second holds the low 16 bits
+        Dir64 = 10
+    };
+    // one block per 4K page
+    struct Block {
+        quint32 pageRVA;
+        int count;
+        const char *entries; // 16-bit entries: type in the top 4 bits, offset into the page in the rest
+    };
+
+    QExeRelocTable();
+    bool read(const QExe &exeDat, QExeErrorInfo *errinfo = nullptr);
+    bool read(const QExeRVAResolver &resolver, quint32 rva, quint32 size, QExeErrorInfo *errinfo = nullptr);
+    int blockCount() const;
+    const Block &blockAt(int index) const;
+    int fixupCount() const;
+    static quint16 entryAt(const Block &block, int index);
+    static Type entryType(quint16 entry);
+    static quint16 entryOffset(quint16 entry);
+
+    // moves the image to newBase, applying every fixup to the section data
+    // if stripRelocs is set, the relocations are removed afterwards and the image is marked as fixed
+    static bool rebase(QExe &exeDat, quint64 newBase, bool stripRelocs = false, QExeErrorInfo *errinfo = nullptr);
+private:
+    QExeRVAResolver m_resolver;
+    QVector<Block> m_blocks;
+    int m_fixupCount;
+};
+
+#endif // QEXERELOCTABLE_H
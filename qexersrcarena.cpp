@@ -0,0 +1,74 @@
+#include "qexersrcarena_p.h"
+
+QExeRsrcArena::QExeRsrcArena(QExeRsrcManager *manager)
+{
+    this->manager = manager;
+    entryCount = 0;
+    m_refs = 0;
+}
+
+QExeRsrcArena::~QExeRsrcArena()
+{
+    QExeRsrcEntry *block;
+    foreach (block, blocks)
+        delete[] block;
+}
+
+QExeRsrcEntry *QExeRsrcArena::allocate(QExeRsrcEntry::Type type)
+{
+    QExeRsrcEntry *entry;
+    if (!freeEntries.isEmpty()) {
+        entry = entryAt(freeEntries.takeLast());
+    } else {
+        if ((entryCount >> BlockShift) >= static_cast<quint32>(blocks.size())) {
+            QExeRsrcEntry *block = new QExeRsrcEntry[BlockSize];
+            quint32 base = static_cast<quint32>(blocks.size()) << BlockShift;
+            for (quint32 i = 0; i < BlockSize; i++) {
+                block[i].m_arena = this;
+                block[i].m_index = base + i;
+            }
+            blocks += block;
+        }
+        entry = entryAt(entryCount++);
+    }
+    entry->reset(type);
+    return entry;
+}
+
+QExeRsrcEntry *QExeRsrcArena::copy(const QExeRsrcEntry *src)
+{
+    QExeRsrcEntry *entry = allocate(src->m_type);
+    entry->name = src->name;
+    entry->id = src->id;
+    entry->data = src->data;
+    entry->dataMeta = src->dataMeta;
+    entry->directoryMeta = src->directoryMeta;
+    // children are copied in the same order, sorted or not
+    entry->m_sorted = src->m_sorted;
+    entry->m_children.reserve(src->m_children.size());
+    for (quint32 index : src->m_children) {
+        QExeRsrcEntry *child = copy(src->m_arena->entryAt(index));
+        child->m_parent = entry->m_index;
+        entry->m_children += child->m_index;
+    }
+    return entry;
+}
+
+void QExeRsrcArena::release(QExeRsrcEntry *entry)
+{
+    for (quint32 index : entry->m_children) {
+        QExeRsrcEntry *child = entryAt(index);
+        child->m_parent = QExeRsrcEntry::NoEntry;
+        if (child->m_handles == 0)
+            release(child);
+    }
+    entry->reset(QExeRsrcEntry::Data);
+    freeEntries += entry->m_index;
+}
+
+void QExeRsrcArena::detach()
+{
+    manager = nullptr;
+    for (quint32 i = 0; i < entryCount; i++)
+        entryAt(i)->m_attached = false;
+}
@@ -0,0 +1,47 @@
+#ifndef QEXERSRCARENA_P_H
+#define QEXERSRCARENA_P_H
+
+#include <QVector>
+
+#include "qexersrcentry.h"
+
+// one generation of a QExeRsrcManager's entries
+// entries are allocated in blocks, so their addresses never change
+// the manager holds a reference for as long as the generation is its tree, and every handle to one of the entries
+// holds another, so a generation outlives the manager (and the manager's next read()) while handles to it exist
+class QExeRsrcArena
+{
+public:
+    explicit QExeRsrcArena(QExeRsrcManager *manager);
+    ~QExeRsrcArena();
+
+    static const int BlockShift = 10;
+    static const quint32 BlockSize = 1u << BlockShift;
+
+    QExeRsrcManager *manager; // nullptr once the manager has let go of this generation
+    QVector<QExeRsrcEntry *> blocks;
+    quint32 entryCount; // entries handed out so far, reclaimed ones included
+    QVector<quint32> freeEntries; // reclaimed entries, reused before new ones are handed out
+
+    QExeRsrcEntry *entryAt(quint32 index) const {
+        return &blocks[static_cast<int>(index >> BlockShift)][index & (BlockSize - 1)];
+    }
+    QExeRsrcEntry *allocate(QExeRsrcEntry::Type type);
+    QExeRsrcEntry *copy(const QExeRsrcEntry *src);
+    // reclaims a detached entry no handle refers to, along with the parts of its subtree no handle refers to
+    // children that are still referred to become detached entries of their own
+    void release(QExeRsrcEntry *entry);
+
+    void ref() { m_refs++; }
+    void deref() {
+        if (--m_refs == 0)
+            delete this;
+    }
+    // called by the manager when it starts over or is destroyed; the entries stay usable, but aren't indexed anymore
+    void detach();
+private:
+    Q_DISABLE_COPY(QExeRsrcArena)
+    quint32 m_refs;
+};
+
+#endif // QEXERSRCARENA_P_H
@@ -0,0 +1,184 @@
+#include "qexersrcdiff.h"
+
+#include <QHash>
+#include <QPair>
+#include <QSet>
+
+#include <algorithm>
+
+#include "qexersrcmanager.h"
+#include "qexersrcarena_p.h"
+#include "qexeconcurrent_p.h"
+#include "qexehash_p.h"
+
+// data entries are hashed in parallel once there's this much of it
+static const quint64 rsrcParallelThreshold = 4 * 1024 * 1024;
+
+QVector<QExeRsrcDiff::Op> QExeRsrcDiff::diff(const QExeRsrcManager &base, const QExeRsrcManager &other, bool removals)
+{
+    QVector<Op> ops;
+    if (&base == &other)
+        return ops;
+    QVector<int> candidates;
+    diffDirectory(base.root(), other.root(), removals, &ops, &candidates);
+    // data entries with the same key, size and code page only differ if their contents do
+    QVector<char> differs(candidates.size());
+    quint64 total = 0;
+    foreach (int index, candidates)
+        total += static_cast<quint64>(ops[index].source->data.size());
+    QExeConcurrent::forEachIndex(candidates.size(), total >= rsrcParallelThreshold, [&ops, &candidates, &differs](int i) {
+        const QByteArray &data1 = ops[candidates[i]].entry->data;
+        const QByteArray &data2 = ops[candidates[i]].source->data;
+        // copied entries share their data
+        differs[i] = data1.constData() != data2.constData() && QExeHash::fnv1a(data1) != QExeHash::fnv1a(data2);
+    });
+    if (candidates.isEmpty())
+        return ops;
+    // drop the replacements that turned out to be no-ops, keeping the rest in order
+    int out = 0, next = 0;
+    for (int i = 0; i < ops.size(); i++) {
+        if (next < candidates.size() && candidates[next] == i) {
+            if (!differs[next++])
+                continue;
+        }
+        if (out != i)
+            ops[out] = ops[i];
+        out++;
+    }
+    ops.resize(out);
+    return ops;
+}
+
+bool QExeRsrcDiff::apply(QExeRsrcManager &base, const QVector<Op> &ops)
+{
+    foreach (const Op &op, ops) {
+        if (op.entry.isNull() || op.entry->manager() != &base || (op.type != Remove && (op.source.isNull() || op.source->manager() == &base)))
+            return false;
+        if (op.type == Add ? op.entry->type() != QExeRsrcEntry::Directory : op.entry->parent().isNull())
+            return false;
+    }
+    // data is replaced in place, anything else is removed and a copy of the replacement added afterwards
+    QVector<const Op *> replaced; // data replaced in place
+    QHash<QExeRsrcEntry *, QSet<quint32>> removed; // directory => arena indexes of removed children
+    QVector<QPair<QExeRsrcEntryPtr, QExeRsrcEntryPtr>> added; // (directory, entry to copy in)
+    foreach (const Op &op, ops) {
+        if (op.type == Add) {
+            added += qMakePair(op.entry, op.source);
+            continue;
+        }
+        if (op.type == Replace && op.entry->type() == QExeRsrcEntry::Data && op.source->type() == QExeRsrcEntry::Data) {
+            replaced += &op;
+            continue;
+        }
+        QExeRsrcEntryPtr parent = op.entry->parent();
+        removed[parent.data()].insert(op.entry->m_index);
+        if (op.type == Replace)
+            added += qMakePair(parent, op.source);
+    }
+    // an added entry mustn't clash with a child that's kept or with another added entry (e.g. when base changed since
+    // diff(), or the same operations are applied twice), this is checked before anything changes
+    QSet<QPair<QExeRsrcEntry *, QPair<quint32, QString>>> addedKeys;
+    for (const auto &pair : added) {
+        const QExeRsrcEntry *source = pair.second.data();
+        QExeRsrcEntryPtr existing = pair.first->findChild(source->id, source->name);
+        if (!existing.isNull() && !removed.value(pair.first.data()).contains(existing->m_index))
+            return false;
+        const QPair<quint32, QString> key(source->name.isEmpty() ? source->id : 0, source->name);
+        if (addedKeys.contains(qMakePair(pair.first.data(), key)))
+            return false;
+        addedKeys.insert(qMakePair(pair.first.data(), key));
+    }
+    foreach (const Op *op, replaced) {
+        op->entry->data = op->source->data;
+        op->entry->dataMeta = op->source->dataMeta;
+    }
+    // each directory's children are filtered once, instead of searched once per removed child
+    for (auto it = removed.constBegin(); it != removed.constEnd(); ++it) {
+        QExeRsrcEntry *dir = it.key();
+        const QSet<quint32> &indexes = it.value();
+        QVector<quint32> kept;
+        kept.reserve(dir->m_children.size() - indexes.size());
+        for (quint32 index : dir->m_children) {
+            if (!indexes.contains(index)) {
+                kept += index;
+                continue;
+            }
+            QExeRsrcEntry *entry = base.entryAt(index);
+            if (dir->m_attached)
+                base.unindexEntry(entry);
+            entry->m_parent = QExeRsrcEntry::NoEntry;
+            if (entry->m_handles == 0)
+                base.m_arena->release(entry);
+        }
+        dir->m_children = kept;
+    }
+    for (const auto &pair : added)
+        pair.first->addChild(pair.second);
+    return true;
+}
+
+int QExeRsrcDiff::merge(QExeRsrcManager &base, const QExeRsrcManager &other)
+{
+    QVector<Op> ops = diff(base, other, false);
+    if (!apply(base, ops))
+        return -1;
+    return ops.size();
+}
+
+void QExeRsrcDiff::diffDirectory(QExeRsrcEntryPtr baseDir, QExeRsrcEntryPtr otherDir, bool removals, QVector<Op> *ops,
+                                 QVector<int> *candidates)
+{
+    const QVector<QExeRsrcEntryPtr> baseChildren = sortedChildren(baseDir);
+    const QVector<QExeRsrcEntryPtr> otherChildren = sortedChildren(otherDir);
+    int i = 0, j = 0;
+    while (i < baseChildren.size() || j < otherChildren.size()) {
+        int cmp;
+        if (i == baseChildren.size())
+            cmp = 1;
+        else if (j == otherChildren.size())
+            cmp = -1;
+        else
+            cmp = QExeRsrcEntry::compareKey(baseChildren[i].data(), otherChildren[j]->id, otherChildren[j]->name);
+        if (cmp < 0) {
+            if (removals) {
+                Op op = { Remove, baseChildren[i], nullptr };
+                *ops += op;
+            }
+            i++;
+            continue;
+        }
+        if (cmp > 0) {
+            Op op = { Add, baseDir, otherChildren[j] };
+            *ops += op;
+            j++;
+            continue;
+        }
+        QExeRsrcEntryPtr baseEntry = baseChildren[i++];
+        QExeRsrcEntryPtr otherEntry = otherChildren[j++];
+        if (baseEntry->type() == QExeRsrcEntry::Directory && otherEntry->type() == QExeRsrcEntry::Directory) {
+            diffDirectory(baseEntry, otherEntry, removals, ops, candidates);
+            continue;
+        }
+        Op op = { Replace, baseEntry, otherEntry };
+        // only entries that look the same from the outside have to be hashed
+        if (baseEntry->type() == otherEntry->type() && baseEntry->data.size() == otherEntry->data.size()
+                && baseEntry->dataMeta.codepage == otherEntry->dataMeta.codepage && baseEntry->dataMeta.reserved == otherEntry->dataMeta.reserved)
+            *candidates += ops->size();
+        *ops += op;
+    }
+}
+
+QVector<QExeRsrcEntryPtr> QExeRsrcDiff::sortedChildren(QExeRsrcEntryPtr dir)
+{
+    QVector<QExeRsrcEntryPtr> ret;
+    ret.reserve(dir->childCount());
+    for (int i = 0; i < dir->childCount(); i++)
+        ret += dir->childAt(i);
+    // usually sorted already, e.g. when read from a well-formed section
+    if (!dir->m_sorted) {
+        std::sort(ret.begin(), ret.end(), [](const QExeRsrcEntryPtr &entry1, const QExeRsrcEntryPtr &entry2) {
+            return QExeRsrcEntry::canonicalLess(entry1.data(), entry2.data());
+        });
+    }
+    return ret;
+}
@@ -0,0 +1,46 @@
+#ifndef QEXERSRCDIFF_H
+#define QEXERSRCDIFF_H
+
+#include "QExe_global.h"
+
+#include <QVector>
+
+#include "qexersrcentry.h"
+
+class QExeRsrcManager;
+
+// differences between two resource trees, as operations that turn one into the other
+// both trees' children are walked side by side in canonical order, so each level is a single merge pass, and data
+// entries are told apart by size and hash (hashed in parallel) instead of comparing their bytes
+class QEXE_EXPORT QExeRsrcDiff
+{
+public:
+    enum OpType : quint8 {
+        Add,
+        Remove,
+        Replace
+    };
+    struct Op {
+        OpType type;
+        QExeRsrcEntryPtr entry; // in the base tree: the entry to remove or replace, or the directory to add to
+        QExeRsrcEntryPtr source; // in the other tree: the entry to add or replace with, null if removing
+    };
+
+    // operations that turn base into other, in path order; the managers have to be different ones
+    // without removals, entries only in base are kept, which merges other into base
+    static QVector<Op> diff(const QExeRsrcManager &base, const QExeRsrcManager &other, bool removals = true);
+    // applies every operation in one batch, or nothing if any of them doesn't belong to base or would add an entry
+    // whose ID/name is taken already
+    // other has to be unchanged since diff(), entries from it are copied into base
+    static bool apply(QExeRsrcManager &base, const QVector<Op> &ops);
+    // adds the entries of other missing from base and replaces those that differ, returns the number of operations
+    // (-1 if they couldn't be applied, leaving base unchanged)
+    static int merge(QExeRsrcManager &base, const QExeRsrcManager &other);
+private:
+    // candidates are replacements of data entries that may turn out to be identical
+    static void diffDirectory(QExeRsrcEntryPtr baseDir, QExeRsrcEntryPtr otherDir, bool removals, QVector<Op> *ops,
+                              QVector<int> *candidates);
+    static QVector<QExeRsrcEntryPtr> sortedChildren(QExeRsrcEntryPtr dir);
+};
+
+#endif // QEXERSRCDIFF_H
@@ -1,59 +1,148 @@
 #include "qexersrcentry.h"
 
+#include <QStringList>
+
+#include <algorithm>
+
+#include "qexersrcmanager.h"
+#include "qexersrcarena_p.h"
+
+QExeRsrcEntryPtr::QExeRsrcEntryPtr(QExeRsrcEntry *entry) : m_entry(entry)
+{
+    if (m_entry != nullptr) {
+        m_entry->m_handles++;
+        m_entry->m_arena->ref();
+    }
+}
+
+QExeRsrcEntryPtr::QExeRsrcEntryPtr(const QExeRsrcEntryPtr &other) : QExeRsrcEntryPtr(other.m_entry)
+{
+}
+
+QExeRsrcEntryPtr::~QExeRsrcEntryPtr()
+{
+    clear();
+}
+
+QExeRsrcEntryPtr &QExeRsrcEntryPtr::operator=(const QExeRsrcEntryPtr &other)
+{
+    if (other.m_entry != m_entry) {
+        QExeRsrcEntryPtr copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+QExeRsrcEntryPtr &QExeRsrcEntryPtr::operator=(QExeRsrcEntryPtr &&other)
+{
+    if (&other != this) {
+        clear();
+        m_entry = other.m_entry;
+        other.m_entry = nullptr;
+    }
+    return *this;
+}
+
+void QExeRsrcEntryPtr::clear()
+{
+    QExeRsrcEntry *entry = m_entry;
+    if (entry == nullptr)
+        return;
+    m_entry = nullptr;
+    QExeRsrcArena *arena = entry->m_arena;
+    // entries in the tree are kept by their parent, and roots by the arena
+    if (--entry->m_handles == 0 && entry->m_parent == QExeRsrcEntry::NoEntry && entry->m_index != 0)
+        arena->release(entry);
+    arena->deref();
+}
+
 QExeRsrcEntry::Type QExeRsrcEntry::type() const
 {
     return m_type;
 }
 
+QExeRsrcManager *QExeRsrcEntry::manager() const
+{
+    return m_arena->manager;
+}
+
+QExeRsrcEntryPtr QExeRsrcEntry::parent() const
+{
+    if (m_parent == NoEntry)
+        return nullptr;
+    return childByIndex(m_parent);
+}
+
+int QExeRsrcEntry::childCount() const
+{
+    return m_children.size();
+}
+
+QExeRsrcEntryPtr QExeRsrcEntry::childAt(int index) const
+{
+    if (index < 0 || index >= m_children.size())
+        return nullptr;
+    return childByIndex(m_children[index]);
+}
+
 std::list<QExeRsrcEntryPtr> QExeRsrcEntry::children() const
 {
-    return m_children;
+    std::list<QExeRsrcEntryPtr> ret;
+    for (quint32 index : m_children)
+        ret.push_back(childByIndex(index));
+    return ret;
 }
 
 bool QExeRsrcEntry::addChild(QExeRsrcEntryPtr child)
 {
     if (m_type != Directory || child.isNull())
         return false;
-    QExeRsrcEntryPtr entry;
-    QString childName = child->name;
-    if (childName.isEmpty()) {
-        // check for conflicting IDs
-        foreach (entry, m_children) {
-            if (child->id == entry->id)
-                return false;
-        }
-    } else {
-        // check for conflicting name
-        foreach (entry, m_children) {
-            if (childName.compare(entry->name) == 0)
+    QExeRsrcEntry *entry = child.data();
+    // check for conflicting ID/name
+    if (!(entry->name.isEmpty() ? this->child(entry->id) : this->child(entry->name)).isNull())
+        return false;
+    if (entry->m_arena != m_arena)
+        // entries can't be shared between managers (or generations of one), so add a copy instead
+        entry = m_arena->copy(entry);
+    else {
+        // entries can only have one parent, and can't (indirectly) contain themselves
+        if (entry->m_parent != NoEntry || entry->m_index == 0)
+            return false;
+        for (quint32 i = m_index; i != NoEntry; i = m_arena->entryAt(i)->m_parent) {
+            if (i == entry->m_index)
                 return false;
         }
     }
-    m_children.push_back(child);
-    child->m_parent = QExeRsrcEntryPtr(this);
+    entry->m_parent = m_index;
+    // stays sorted as long as children are added in order (e.g. when reading a well-formed section)
+    if (m_sorted && !m_children.isEmpty() && !canonicalLess(m_arena->entryAt(m_children.last()), entry))
+        m_sorted = false;
+    m_children += entry->m_index;
+    if (m_attached)
+        m_arena->manager->indexEntry(entry);
     return true;
 }
 
 QExeRsrcEntryPtr QExeRsrcEntry::createChild(QExeRsrcEntry::Type type, const QString &name)
 {
-    if (m_type != Directory)
+    if (m_type != Directory || !child(name).isNull())
         return nullptr;
-    QExeRsrcEntryPtr child = QExeRsrcEntryPtr(new QExeRsrcEntry(type));
-    child->name = name;
-    if (!addChild(child))
+    QExeRsrcEntry *entry = m_arena->allocate(type);
+    entry->name = name;
+    if (!addChild(QExeRsrcEntryPtr(entry)))
         return nullptr;
-    return child;
+    return QExeRsrcEntryPtr(entry);
 }
 
 QExeRsrcEntryPtr QExeRsrcEntry::createChild(QExeRsrcEntry::Type type, const quint32 id)
 {
-    if (m_type != Directory)
+    if (m_type != Directory || !child(id).isNull())
         return nullptr;
-    QExeRsrcEntryPtr child = QExeRsrcEntryPtr(new QExeRsrcEntry(type));
-    child->id = id;
-    if (!addChild(child))
+    QExeRsrcEntry *entry = m_arena->allocate(type);
+    entry->id = id;
+    if (!addChild(QExeRsrcEntryPtr(entry)))
         return nullptr;
-    return child;
+    return QExeRsrcEntryPtr(entry);
 }
 
 QExeRsrcEntryPtr QExeRsrcEntry::createChildIfAbsent(QExeRsrcEntry::Type type, const QString &name)
@@ -61,7 +150,7 @@ QExeRsrcEntryPtr QExeRsrcEntry::createChildIfAbsent(QExeRsrcEntry::Type type, co
     QExeRsrcEntryPtr ret = createChild(type, name);
     if (ret.isNull()) {
         ret = child(name);
-        if (ret->type() != type)
+        if (!ret.isNull() && ret->type() != type)
             ret = nullptr;
     }
     return ret;
@@ -72,7 +161,7 @@ QExeRsrcEntryPtr QExeRsrcEntry::createChildIfAbsent(QExeRsrcEntry::Type type, co
     QExeRsrcEntryPtr ret = createChild(type, id);
     if (ret.isNull()) {
         ret = child(id);
-        if (ret->type() != type)
+        if (!ret.isNull() && ret->type() != type)
             ret = nullptr;
     }
     return ret;
@@ -80,60 +169,192 @@ QExeRsrcEntryPtr QExeRsrcEntry::createChildIfAbsent(QExeRsrcEntry::Type type, co
 
 QExeRsrcEntryPtr QExeRsrcEntry::child(const QString &name) const
 {
-    QExeRsrcEntryPtr entry;
-    foreach (entry, m_children) {
-        if (name.compare(entry->name) == 0)
-            return entry;
-    }
-    return nullptr;
+    if (name.isEmpty())
+        return nullptr;
+    if (m_attached)
+        return m_arena->manager->indexedChild(m_index, name);
+    return findChild(0, name);
 }
 
 QExeRsrcEntryPtr QExeRsrcEntry::child(const quint32 id) const
 {
-    QExeRsrcEntryPtr entry;
-    foreach (entry, m_children) {
-        if (id == entry->id)
-            return entry;
-    }
-    return nullptr;
+    if (m_attached)
+        return m_arena->manager->indexedChild(m_index, id);
+    return findChild(id, QString());
 }
 
 QExeRsrcEntryPtr QExeRsrcEntry::removeChild(const QString &name)
 {
-    QExeRsrcEntryPtr entry = child(name);
-    if (entry.isNull())
-        return entry;
-    m_children.remove(entry);
-    return entry;
+    return detachChild(child(name));
 }
 
 QExeRsrcEntryPtr QExeRsrcEntry::removeChild(const quint32 id)
 {
-    QExeRsrcEntryPtr entry = child(id);
-    if (entry.isNull())
-        return entry;
-    m_children.remove(entry);
-    return entry;
+    return detachChild(child(id));
 }
 
 std::list<QExeRsrcEntryPtr> QExeRsrcEntry::removeAllChildren()
 {
-    std::list<QExeRsrcEntryPtr> ret = m_children;
+    std::list<QExeRsrcEntryPtr> ret;
+    for (quint32 index : m_children) {
+        QExeRsrcEntry *entry = m_arena->entryAt(index);
+        if (m_attached)
+            m_arena->manager->unindexEntry(entry);
+        entry->m_parent = NoEntry;
+        ret.push_back(QExeRsrcEntryPtr(entry));
+    }
     m_children.clear();
+    m_sorted = true;
     return ret;
 }
 
+bool QExeRsrcEntry::rename(const QString &name)
+{
+    if (name.isEmpty())
+        return false;
+    return setKey(0, name);
+}
+
+bool QExeRsrcEntry::rename(const quint32 id)
+{
+    return setKey(id, QString());
+}
+
 QString QExeRsrcEntry::path() const {
-    if (m_parent.isNull())
+    if (m_parent == NoEntry)
         return QStringLiteral("/");
-    return QStringLiteral("%1%2%3").arg(
-                m_parent->path(),
-                name.isEmpty() ? QStringLiteral("*%1").arg(id) : name,
-                m_type == Directory ? "/" : ""
-                );
+    QStringList parts;
+    for (const QExeRsrcEntry *entry = this; entry->m_parent != NoEntry; entry = m_arena->entryAt(entry->m_parent))
+        parts.prepend(entry->name.isEmpty() ? QStringLiteral("*%1").arg(entry->id) : entry->name);
+    return QStringLiteral("/%1%2").arg(parts.join(QLatin1Char('/')), m_type == Directory ? QStringLiteral("/") : QString());
+}
+
+int QExeRsrcEntry::compareNames(const QString &name1, const QString &name2)
+{
+    // the Windows loader compares upper-cased names
+    const int len = qMin(name1.size(), name2.size());
+    for (int i = 0; i < len; i++) {
+        ushort c1 = name1.at(i).toUpper().unicode();
+        ushort c2 = name2.at(i).toUpper().unicode();
+        if (c1 != c2)
+            return c1 < c2 ? -1 : 1;
+    }
+    if (name1.size() != name2.size())
+        return name1.size() < name2.size() ? -1 : 1;
+    return name1.compare(name2);
+}
+
+QExeRsrcEntry::QExeRsrcEntry()
+{
+    m_arena = nullptr;
+    m_index = 0;
+    m_handles = 0;
+    reset(Data);
 }
 
-QExeRsrcEntry::QExeRsrcEntry(Type type, QObject *parent) : QObject(parent)
+void QExeRsrcEntry::reset(Type type)
 {
+    name.clear();
+    id = 0;
+    data.clear();
+    dataMeta.codepage = 0;
+    dataMeta.reserved = 0;
+    directoryMeta.characteristics = 0;
+    directoryMeta.timestamp = 0;
+    directoryMeta.version = Version16(0, 0);
+    m_parent = NoEntry;
     m_type = type;
+    m_attached = false;
+    m_sorted = true;
+    m_children.clear();
+}
+
+// named entries come first, sorted by name, followed by ID entries sorted by ID
+int QExeRsrcEntry::compareKey(const QExeRsrcEntry *entry, quint32 id, const QString &name)
+{
+    if (entry->name.isEmpty() != name.isEmpty())
+        return entry->name.isEmpty() ? 1 : -1;
+    if (name.isEmpty())
+        return entry->id < id ? -1 : (entry->id > id ? 1 : 0);
+    return compareNames(entry->name, name);
+}
+
+bool QExeRsrcEntry::canonicalLess(const QExeRsrcEntry *entry1, const QExeRsrcEntry *entry2)
+{
+    return compareKey(entry1, entry2->id, entry2->name) < 0;
+}
+
+void QExeRsrcEntry::sortChildren()
+{
+    if (m_sorted)
+        return;
+    QExeRsrcArena *arena = m_arena;
+    std::sort(m_children.begin(), m_children.end(), [arena](quint32 index1, quint32 index2) {
+        return canonicalLess(arena->entryAt(index1), arena->entryAt(index2));
+    });
+    m_sorted = true;
+}
+
+QExeRsrcEntryPtr QExeRsrcEntry::findChild(quint32 id, const QString &name) const
+{
+    if (m_sorted) {
+        int lo = 0, hi = m_children.size();
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            QExeRsrcEntry *entry = m_arena->entryAt(m_children[mid]);
+            int cmp = compareKey(entry, id, name);
+            if (cmp == 0)
+                return QExeRsrcEntryPtr(entry);
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return nullptr;
+    }
+    for (quint32 index : m_children) {
+        QExeRsrcEntry *entry = m_arena->entryAt(index);
+        if (compareKey(entry, id, name) == 0)
+            return QExeRsrcEntryPtr(entry);
+    }
+    return nullptr;
+}
+
+bool QExeRsrcEntry::setKey(quint32 id, const QString &name)
+{
+    if (m_parent == NoEntry) {
+        this->id = id;
+        this->name = name;
+        return true;
+    }
+    QExeRsrcEntry *parent = m_arena->entryAt(m_parent);
+    QExeRsrcEntryPtr existing = name.isEmpty() ? parent->child(id) : parent->child(name);
+    if (!existing.isNull())
+        return existing.data() == this;
+    // the index is keyed on the name/ID, so the entry has to be taken out under its old one
+    if (m_attached)
+        m_arena->manager->unindexEntry(this);
+    this->id = id;
+    this->name = name;
+    if (parent->m_attached)
+        m_arena->manager->indexEntry(this);
+    if (parent->m_children.size() > 1)
+        parent->m_sorted = false;
+    return true;
+}
+
+QExeRsrcEntryPtr QExeRsrcEntry::childByIndex(quint32 index) const
+{
+    return QExeRsrcEntryPtr(m_arena->entryAt(index));
+}
+
+QExeRsrcEntryPtr QExeRsrcEntry::detachChild(QExeRsrcEntryPtr child)
+{
+    if (child.isNull())
+        return child;
+    m_children.removeOne(child->m_index);
+    if (m_attached)
+        m_arena->manager->unindexEntry(child.data());
+    child->m_parent = NoEntry;
+    return child;
 }
@@ -5,18 +5,63 @@
 
 class QExeRsrcManager;
 
-#include <QSharedPointer>
-#include <QLinkedList>
+#include <QObject>
+#include <QHash>
+#include <QVector>
+
+#include <list>
 
 #include "typedef_version.h"
 
 class QExeRsrcEntry;
-typedef QSharedPointer<QExeRsrcEntry> QExeRsrcEntryPtr;
-typedef QSharedPointer<const QExeRsrcEntry> QExeRsrcEntryConstPtr;
+class QExeRsrcArena;
+
+// handle to a resource entry
+// entries live in their manager's arena instead of being allocated one by one, but handles keep them alive the way
+// the QSharedPointer handles of earlier versions did:
+//  - an entry that's removed from its tree stays usable until the last handle to it goes away, then it's reclaimed
+//  - when the manager reads another section or is destroyed, the entries it had stay usable for as long as handles
+//    to them exist, as a tree of their own that no manager() owns anymore; call root() again to get the new tree
+// unlike QSharedPointer, handles aren't thread-safe: handles to entries of one manager must be used from one thread
+class QEXE_EXPORT QExeRsrcEntryPtr
+{
+public:
+    QExeRsrcEntryPtr() : m_entry(nullptr) {}
+    QExeRsrcEntryPtr(std::nullptr_t) : m_entry(nullptr) {}
+    QExeRsrcEntryPtr(const QExeRsrcEntryPtr &other);
+    QExeRsrcEntryPtr(QExeRsrcEntryPtr &&other) : m_entry(other.m_entry) { other.m_entry = nullptr; }
+    ~QExeRsrcEntryPtr();
+    QExeRsrcEntryPtr &operator=(const QExeRsrcEntryPtr &other);
+    QExeRsrcEntryPtr &operator=(QExeRsrcEntryPtr &&other);
+    void clear();
+    bool isNull() const { return m_entry == nullptr; }
+    explicit operator bool() const { return m_entry != nullptr; }
+    bool operator!() const { return m_entry == nullptr; }
+    QExeRsrcEntry *data() const { return m_entry; }
+    QExeRsrcEntry *operator->() const { return m_entry; }
+    QExeRsrcEntry &operator*() const { return *m_entry; }
+    bool operator==(const QExeRsrcEntryPtr &other) const { return m_entry == other.m_entry; }
+    bool operator!=(const QExeRsrcEntryPtr &other) const { return m_entry != other.m_entry; }
+private:
+    friend class QExeRsrcEntry;
+    friend class QExeRsrcManager;
 
-class QEXE_EXPORT QExeRsrcEntry : public QObject
+    explicit QExeRsrcEntryPtr(QExeRsrcEntry *entry);
+    QExeRsrcEntry *m_entry;
+};
+
+inline uint qHash(const QExeRsrcEntryPtr &ptr, uint seed = 0)
+{
+    return qHash(ptr.data(), seed);
+}
+
+typedef QExeRsrcEntryPtr QExeRsrcEntryConstPtr;
+
+// entries used to be QObjects, but never had signals or properties of their own
+// they're gadgets now, which is what allows them to be allocated in bulk
+class QEXE_EXPORT QExeRsrcEntry
 {
-    Q_OBJECT
+    Q_GADGET
 public:
     enum RootDirectory : quint32 {
         Cursor = 0x1,
@@ -44,6 +89,7 @@ public:
     };
     Q_ENUM(Type)
     Type type() const;
+    // once the entry has a parent, change these through rename(), which keeps lookups and ordering up to date
     QString name;
     quint32 id;
     QByteArray data;
@@ -57,6 +103,11 @@ public:
         Version16 version;
     } directoryMeta;
 
+    // nullptr if the manager has read another section or has been destroyed since
+    QExeRsrcManager *manager() const;
+    QExeRsrcEntryPtr parent() const;
+    int childCount() const;
+    QExeRsrcEntryPtr childAt(int index) const;
     std::list<QExeRsrcEntryPtr> children() const;
     bool addChild(QExeRsrcEntryPtr child);
     QExeRsrcEntryPtr createChild(Type type, const QString &name);
@@ -68,15 +119,39 @@ public:
     QExeRsrcEntryPtr removeChild(const QString &name);
     QExeRsrcEntryPtr removeChild(const quint32 id);
     std::list<QExeRsrcEntryPtr> removeAllChildren();
+    // fails if a sibling already has the new name/ID
+    bool rename(const QString &name);
+    bool rename(const quint32 id);
 
     QString path() const;
+
+    // compares names the way the PE spec orders them: case-insensitively, ties broken case-sensitively
+    static int compareNames(const QString &name1, const QString &name2);
 private:
+    friend class QExeRsrcEntryPtr;
+    friend class QExeRsrcArena;
     friend class QExeRsrcManager;
+    friend class QExeRsrcDiff;
 
-    explicit QExeRsrcEntry(Type type, QObject *parent = nullptr);
-    QExeRsrcEntryPtr m_parent;
+    static const quint32 NoEntry = 0xFFFFFFFF;
+    QExeRsrcEntry();
+    Q_DISABLE_COPY(QExeRsrcEntry)
+    void reset(Type type);
+    QExeRsrcArena *m_arena;
+    quint32 m_index; // position in the arena
+    quint32 m_handles; // number of QExeRsrcEntryPtrs referring to this entry
+    quint32 m_parent; // arena index of the parent, or NoEntry if detached
     Type m_type;
-    std::list<QExeRsrcEntryPtr> m_children;
+    bool m_attached; // true if connected to the root of the manager's current arena, and thus indexed
+    bool m_sorted; // true if m_children is known to be in canonical order
+    QVector<quint32> m_children; // arena indexes
+    static int compareKey(const QExeRsrcEntry *entry, quint32 id, const QString &name);
+    static bool canonicalLess(const QExeRsrcEntry *entry1, const QExeRsrcEntry *entry2);
+    void sortChildren();
+    QExeRsrcEntryPtr findChild(quint32 id, const QString &name) const;
+    bool setKey(quint32 id, const QString &name);
+    QExeRsrcEntryPtr childByIndex(quint32 index) const;
+    QExeRsrcEntryPtr detachChild(QExeRsrcEntryPtr child);
 };
 
 #endif // QEXERSRCENTRY_H
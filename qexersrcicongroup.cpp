@@ -0,0 +1,109 @@
+#include "qexersrcicongroup.h"
+
+#include <QtEndian>
+
+static const int headerSize = 6;
+static const int entrySize = 14;
+
+QExeRsrcIconGroup::QExeRsrcIconGroup()
+{
+    m_type = Icon;
+    m_count = 0;
+    m_valid = false;
+}
+
+QExeRsrcIconGroup::QExeRsrcIconGroup(const QByteArray &data)
+{
+    m_data = data;
+    m_type = Icon;
+    m_count = 0;
+    m_valid = false;
+    if (m_data.size() < headerSize)
+        return;
+    const char *base = m_data.constData();
+    quint16 type = qFromLittleEndian<quint16>(base + 2);
+    if (qFromLittleEndian<quint16>(base) != 0 || (type != Icon && type != Cursor))
+        return;
+    m_type = static_cast<Type>(type);
+    m_count = qFromLittleEndian<quint16>(base + 4);
+    if (headerSize + m_count * entrySize > m_data.size()) {
+        m_count = 0;
+        return;
+    }
+    m_valid = true;
+}
+
+bool QExeRsrcIconGroup::isValid() const
+{
+    return m_valid;
+}
+
+QExeRsrcIconGroup::Type QExeRsrcIconGroup::type() const
+{
+    return m_type;
+}
+
+int QExeRsrcIconGroup::count() const
+{
+    return m_count;
+}
+
+QExeRsrcIconGroup::Entry QExeRsrcIconGroup::entryAt(int index) const
+{
+    Entry ret = {};
+    if (index < 0 || index >= m_count)
+        return ret;
+    const uchar *src = reinterpret_cast<const uchar *>(m_data.constData()) + headerSize + index * entrySize;
+    if (m_type == Icon) {
+        ret.width = src[0] == 0 ? 256 : src[0];
+        ret.height = src[1] == 0 ? 256 : src[1];
+        ret.colorCount = src[2];
+    } else {
+        ret.width = qFromLittleEndian<quint16>(src);
+        ret.height = qFromLittleEndian<quint16>(src + 2);
+        ret.colorCount = 0;
+    }
+    ret.planes = qFromLittleEndian<quint16>(src + 4);
+    ret.bitCount = qFromLittleEndian<quint16>(src + 6);
+    ret.bytesInRes = qFromLittleEndian<quint32>(src + 8);
+    ret.id = qFromLittleEndian<quint16>(src + 12);
+    return ret;
+}
+
+QVector<QExeRsrcIconGroup::Entry> QExeRsrcIconGroup::entries() const
+{
+    QVector<Entry> ret;
+    ret.reserve(m_count);
+    for (int i = 0; i < m_count; i++)
+        ret += entryAt(i);
+    return ret;
+}
+
+QByteArray QExeRsrcIconGroup::encode(Type type, const QVector<Entry> &entries)
+{
+    if (entries.size() > 0xFFFF)
+        return QByteArray();
+    QByteArray ret(headerSize + entries.size() * entrySize, 0);
+    uchar *dst = reinterpret_cast<uchar *>(ret.data());
+    qToLittleEndian<quint16>(type, dst + 2);
+    qToLittleEndian<quint16>(static_cast<quint16>(entries.size()), dst + 4);
+    dst += headerSize;
+    foreach (const Entry &entry, entries) {
+        if (type == Icon) {
+            if (entry.width > 256 || entry.height > 256)
+                return QByteArray();
+            dst[0] = static_cast<uchar>(entry.width & 0xFF);
+            dst[1] = static_cast<uchar>(entry.height & 0xFF);
+            dst[2] = entry.colorCount;
+        } else {
+            qToLittleEndian<quint16>(entry.width, dst);
+            qToLittleEndian<quint16>(entry.height, dst + 2);
+        }
+        qToLittleEndian<quint16>(entry.planes, dst + 4);
+        qToLittleEndian<quint16>(entry.bitCount, dst + 6);
+        qToLittleEndian<quint32>(entry.bytesInRes, dst + 8);
+        qToLittleEndian<quint16>(entry.id, dst + 12);
+        dst += entrySize;
+    }
+    return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef QEXERSRCICONGROUP_H
+#define QEXERSRCICONGROUP_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QVector>
+
+// view over an icon or cursor group directory (the data of a QExeRsrcEntry::IconGroup or CursrorGroup entry)
+// the view shares the directory's bytes, entries are decoded when asked for
+class QEXE_EXPORT QExeRsrcIconGroup
+{
+public:
+    enum Type : quint16 {
+        Icon = 1,
+        Cursor = 2
+    };
+    struct Entry {
+        quint16 width; // icons store 256 as 0, this is the real size
+        quint16 height;
+        quint8 colorCount; // always 0 for cursors
+        quint16 planes;
+        quint16 bitCount; // cursor hotspots aren't here, they're at the start of the RT_CURSOR data
+        quint32 bytesInRes;
+        quint16 id; // ID of the QExeRsrcEntry::Icon/Cursor entry holding the image
+    };
+    QExeRsrcIconGroup();
+    explicit QExeRsrcIconGroup(const QByteArray &data);
+    bool isValid() const;
+    Type type() const;
+    int count() const;
+    Entry entryAt(int index) const;
+    QVector<Entry> entries() const;
+
+    // returns a null QByteArray if entries can't be encoded
+    static QByteArray encode(Type type, const QVector<Entry> &entries);
+private:
+    QByteArray m_data;
+    Type m_type;
+    int m_count;
+    bool m_valid;
+};
+
+#endif // QEXERSRCICONGROUP_H
@@ -2,10 +2,18 @@
 
 #include <QBuffer>
 #include <QtEndian>
-#include <QTextCodec>
 #include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+
+#include <algorithm>
+#include <limits>
 
 #include "qexe.h"
+#include "qexersrcarena_p.h"
+#include "qexeutf16_p.h"
+#include "qexeconcurrent_p.h"
 
 #define SET_ERROR_INFO(errName) \
     if (errinfo != nullptr) { \
@@ -13,75 +21,368 @@
     }
 
 constexpr quint32 hiMask = 0x80000000;
+const quint32 rsrcDataAlign = 4; // .rsrc data is aligned to DWORD boundary
 
 QExeRsrcManager::QExeRsrcManager(QObject *parent) : QObject(parent)
 {
-    m_root = QExeRsrcEntryPtr(new QExeRsrcEntry(QExeRsrcEntry::Directory));
+    m_arena = nullptr;
+    resetArena();
+}
+
+QExeRsrcManager::~QExeRsrcManager()
+{
+    m_arena->detach();
+    m_arena->deref();
 }
 
 QExeRsrcEntryPtr QExeRsrcManager::root() const
 {
-    return m_root;
+    return QExeRsrcEntryPtr(entryAt(0));
 }
 
-void QExeRsrcManager::correctOffsets(QExeSectionPtr rsrcSec, const qint64 shift)
+QVector<QExeRsrcEntryPtr> QExeRsrcManager::find(const QExeRsrcQuery &query) const
 {
-    QBuffer buf(&rsrcSec->rawData);
-    buf.open(QBuffer::ReadWrite);
-    QDataStream ds(&buf);
-    ds.setByteOrder(QDataStream::LittleEndian);
-    shiftDirectory(buf, ds, shift, 0);
-    buf.close();
+    QVector<QExeRsrcEntryPtr> ret;
+    if (query.isValid())
+        matchQuery(query, 0, entryAt(0), &ret, false);
+    return ret;
 }
 
-void QExeRsrcManager::shiftDirectory(QBuffer &buf, QDataStream &ds, const qint64 shift, const quint32 ptr)
+QVector<QExeRsrcEntryPtr> QExeRsrcManager::find(const QString &pattern) const
 {
-    buf.seek(ptr + 12);
-    quint16 entriesName, entriesID;
-    ds >> entriesName;
-    ds >> entriesID;
-    const quint32 entries = entriesName + entriesID;
+    return find(QExeRsrcQuery(pattern));
+}
 
-    quint32 results[entries];
-    for (quint32 i = 0; i < entries; i++) {
-        quint32 result;
-        ds >> result; // throw this one away
-        ds >> result;
-        results[i] = result;
+QExeRsrcEntryPtr QExeRsrcManager::findFirst(const QExeRsrcQuery &query) const
+{
+    QVector<QExeRsrcEntryPtr> ret;
+    if (query.isValid() && matchQuery(query, 0, entryAt(0), &ret, true))
+        return ret.first();
+    return nullptr;
+}
+
+bool QExeRsrcManager::matchQuery(const QExeRsrcQuery &query, int depth, const QExeRsrcEntry *dir, QVector<QExeRsrcEntryPtr> *out, bool firstOnly) const
+{
+    const QExeRsrcQuery::Component &comp = query.m_components[depth];
+    const bool last = depth == query.m_components.size() - 1;
+    QExeRsrcEntryPtr matches[2];
+    int matchCount = 0;
+    switch (comp.kind) {
+    case QExeRsrcQuery::Component::Any:
+        for (quint32 index : dir->m_children) {
+            QExeRsrcEntry *entry = entryAt(index);
+            if (last) {
+                *out += QExeRsrcEntryPtr(entry);
+                if (firstOnly)
+                    return true;
+            } else if (entry->m_type == QExeRsrcEntry::Directory) {
+                if (matchQuery(query, depth + 1, entry, out, firstOnly) && firstOnly)
+                    return true;
+            }
+        }
+        return !out->isEmpty();
+    case QExeRsrcQuery::Component::ID:
+        matches[matchCount++] = indexedChild(dir->m_index, comp.id);
+        break;
+    case QExeRsrcQuery::Component::Name:
+        matches[matchCount++] = indexedChild(dir->m_index, comp.name);
+        break;
+    case QExeRsrcQuery::Component::NameOrID:
+        matches[matchCount++] = indexedChild(dir->m_index, comp.id);
+        matches[matchCount++] = indexedChild(dir->m_index, comp.name);
+        break;
+    }
+    for (int i = 0; i < matchCount; i++) {
+        const QExeRsrcEntryPtr &entry = matches[i];
+        if (entry.isNull())
+            continue;
+        if (last) {
+            *out += entry;
+            if (firstOnly)
+                return true;
+        } else if (entry->m_type == QExeRsrcEntry::Directory) {
+            if (matchQuery(query, depth + 1, entry.data(), out, firstOnly) && firstOnly)
+                return true;
+        }
+    }
+    return !out->isEmpty();
+}
+
+QExeRsrcEntry *QExeRsrcManager::entryAt(quint32 index) const
+{
+    return m_arena->entryAt(index);
+}
+
+void QExeRsrcManager::resetArena()
+{
+    m_index.clear();
+    // the old entries are left to the handles that still refer to them
+    if (m_arena != nullptr) {
+        m_arena->detach();
+        m_arena->deref();
+    }
+    m_arena = new QExeRsrcArena(this);
+    m_arena->ref();
+    QExeRsrcEntry *root = m_arena->allocate(QExeRsrcEntry::Directory);
+    root->m_attached = true;
+}
+
+void QExeRsrcManager::indexEntry(QExeRsrcEntry *entry)
+{
+    IndexKey key;
+    key.parent = entry->m_parent;
+    key.id = entry->name.isEmpty() ? entry->id : 0;
+    key.name = entry->name;
+    m_index.insert(key, entry);
+    entry->m_attached = true;
+    for (quint32 index : entry->m_children)
+        indexEntry(entryAt(index));
+}
+
+void QExeRsrcManager::unindexEntry(QExeRsrcEntry *entry)
+{
+    for (quint32 index : entry->m_children)
+        unindexEntry(entryAt(index));
+    IndexKey key;
+    key.parent = entry->m_parent;
+    key.id = entry->name.isEmpty() ? entry->id : 0;
+    key.name = entry->name;
+    m_index.remove(key);
+    entry->m_attached = false;
+}
+
+QExeRsrcEntryPtr QExeRsrcManager::indexedChild(quint32 parent, quint32 id) const
+{
+    IndexKey key;
+    key.parent = parent;
+    key.id = id;
+    return QExeRsrcEntryPtr(m_index.value(key));
+}
+
+QExeRsrcEntryPtr QExeRsrcManager::indexedChild(quint32 parent, const QString &name) const
+{
+    if (name.isEmpty())
+        return nullptr;
+    IndexKey key;
+    key.parent = parent;
+    key.id = 0;
+    key.name = name;
+    return QExeRsrcEntryPtr(m_index.value(key));
+}
+
+// path components use the same format as QExeRsrcEntry::path(): "*<id>" for IDs, anything else is a name
+struct RsrcPathComponent {
+    bool isID;
+    quint32 id;
+    QString name;
+};
+
+static bool parseRsrcPath(const QString &path, QVector<RsrcPathComponent> *out)
+{
+    const QStringList parts = path.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    if (parts.isEmpty())
+        return false;
+    QString part;
+    foreach (part, parts) {
+        RsrcPathComponent comp;
+        comp.isID = part.startsWith(QLatin1Char('*'));
+        comp.id = 0;
+        if (comp.isID) {
+            bool ok = false;
+            comp.id = part.midRef(1).toUInt(&ok);
+            if (!ok)
+                return false;
+        } else
+            comp.name = part;
+        *out += comp;
+    }
+    return true;
+}
+
+// compares the directory entry at entryOff to comp, in the order used by QExeRsrcEntry (names first, see compareNames)
+// returns 2 if the entry is malformed
+static int compareRsrcEntry(const QByteArray &raw, qint64 entryOff, const RsrcPathComponent &comp)
+{
+    const uchar *base = reinterpret_cast<const uchar *>(raw.constData());
+    quint32 nameField = qFromLittleEndian<quint32>(base + entryOff);
+    bool isName = (nameField & hiMask) != 0;
+    if (isName == comp.isID)
+        return isName ? -1 : 1;
+    if (comp.isID)
+        return nameField < comp.id ? -1 : (nameField > comp.id ? 1 : 0);
+    quint32 nameOff = nameField & ~hiMask;
+    if (static_cast<qint64>(nameOff) + 2 > raw.size())
+        return 2;
+    int nameLen = qFromLittleEndian<quint16>(base + nameOff);
+    if (static_cast<qint64>(nameOff) + 2 + nameLen * 2 > raw.size())
+        return 2;
+    const uchar *name = base + nameOff + 2;
+    const int len = qMin(nameLen, comp.name.size());
+    for (int i = 0; i < len; i++) {
+        ushort c1 = QChar(qFromLittleEndian<quint16>(name + i * 2)).toUpper().unicode();
+        ushort c2 = comp.name.at(i).toUpper().unicode();
+        if (c1 != c2)
+            return c1 < c2 ? -1 : 1;
+    }
+    if (nameLen != comp.name.size())
+        return nameLen < comp.name.size() ? -1 : 1;
+    for (int i = 0; i < len; i++) {
+        ushort c1 = qFromLittleEndian<quint16>(name + i * 2);
+        ushort c2 = comp.name.at(i).unicode();
+        if (c1 != c2)
+            return c1 < c2 ? -1 : 1;
+    }
+    return 0;
+}
+
+// finds the offset of the data description at the end of path, or 0 if it doesn't exist
+static quint32 findRsrcDataDesc(const QByteArray &raw, const QVector<RsrcPathComponent> &path)
+{
+    const uchar *base = reinterpret_cast<const uchar *>(raw.constData());
+    const qint64 rawSize = raw.size();
+    quint32 dirOff = 0;
+    for (int i = 0; i < path.size(); i++) {
+        if (static_cast<qint64>(dirOff) + 16 > rawSize)
+            return 0;
+        qint64 entries = qFromLittleEndian<quint16>(base + dirOff + 12) + qFromLittleEndian<quint16>(base + dirOff + 14);
+        if (static_cast<qint64>(dirOff) + 16 + entries * 8 > rawSize)
+            return 0;
+        const RsrcPathComponent &comp = path[i];
+        qint64 entryOff = -1;
+        // well-formed sections are sorted, so try a binary search first
+        qint64 lo = 0, hi = entries;
+        while (lo < hi) {
+            qint64 mid = lo + (hi - lo) / 2;
+            int cmp = compareRsrcEntry(raw, dirOff + 16 + mid * 8, comp);
+            if (cmp == 0) {
+                entryOff = dirOff + 16 + mid * 8;
+                break;
+            }
+            if (cmp == 2)
+                break;
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        // fall back to a linear search, in case this section isn't sorted
+        for (qint64 j = 0; entryOff < 0 && j < entries; j++) {
+            if (compareRsrcEntry(raw, dirOff + 16 + j * 8, comp) == 0)
+                entryOff = dirOff + 16 + j * 8;
+        }
+        if (entryOff < 0)
+            return 0;
+        quint32 dataField = qFromLittleEndian<quint32>(base + entryOff + 4);
+        bool isDir = (dataField & hiMask) != 0;
+        // intermediate components must be directories, the last one must be data
+        if (isDir != (i < path.size() - 1))
+            return 0;
+        dirOff = dataField & ~hiMask;
     }
+    if (static_cast<qint64>(dirOff) + 16 > rawSize)
+        return 0;
+    return dirOff;
+}
 
+// calculates how many bytes of the section are actually in use
+static quint32 usedRsrcSize(const QByteArray &raw, quint32 virtualAddr, quint32 dirOff, int depth = 0)
+{
+    const uchar *base = reinterpret_cast<const uchar *>(raw.constData());
+    const qint64 rawSize = raw.size();
+    // guard against malformed (looping) directories
+    if (depth > 32 || static_cast<qint64>(dirOff) + 16 > rawSize)
+        return 0;
+    quint32 entries = qFromLittleEndian<quint16>(base + dirOff + 12) + qFromLittleEndian<quint16>(base + dirOff + 14);
+    quint32 used = dirOff + 16 + entries * 8;
     for (quint32 i = 0; i < entries; i++) {
-        if ((results[i] & hiMask) != 0)
-            shiftDirectory(buf, ds, shift, results[i] & ~hiMask);
-        else {
-            buf.seek(results[i]);
-            quint32 val;
-            ds >> val;
-            buf.seek(results[i]);
-            val += shift;
-            ds << val;
+        qint64 entryOff = dirOff + 16 + i * 8;
+        if (entryOff + 8 > rawSize)
+            break;
+        quint32 nameField = qFromLittleEndian<quint32>(base + entryOff);
+        quint32 dataField = qFromLittleEndian<quint32>(base + entryOff + 4);
+        if ((nameField & hiMask) != 0) {
+            quint32 nameOff = nameField & ~hiMask;
+            if (static_cast<qint64>(nameOff) + 2 <= rawSize)
+                used = qMax(used, nameOff + 2 + qFromLittleEndian<quint16>(base + nameOff) * 2u);
+        }
+        if ((dataField & hiMask) != 0)
+            used = qMax(used, usedRsrcSize(raw, virtualAddr, dataField & ~hiMask, depth + 1));
+        else if (static_cast<qint64>(dataField) + 16 <= rawSize) {
+            used = qMax(used, dataField + 16);
+            quint32 dataPtr = qFromLittleEndian<quint32>(base + dataField);
+            quint32 dataSize = qFromLittleEndian<quint32>(base + dataField + 4);
+            if (dataPtr >= virtualAddr)
+                used = qMax(used, dataPtr - virtualAddr + dataSize);
         }
     }
+    return used;
 }
 
-bool QExeRsrcManager::addBeforeRsrcSection(QSharedPointer<QExeSectionManager> secMgr, QExeSectionPtr sec)
+// counts how many data descriptions point to dataPtr (blobs may be shared, see toSection)
+static int countRsrcDataRefs(const QByteArray &raw, quint32 dataPtr, quint32 dirOff, int depth = 0)
 {
-    QExeSectionPtr rsrcSec = secMgr->removeSection(secMgr->rsrcSectionIndex());
-    quint32 oldRVA = 0;
-    if (!rsrcSec.isNull())
-        oldRVA = rsrcSec->virtualAddr;
-    if (!secMgr->addSection(sec)) {
-        secMgr->addSection(rsrcSec);
-        return false;
+    const uchar *base = reinterpret_cast<const uchar *>(raw.constData());
+    const qint64 rawSize = raw.size();
+    if (depth > 32 || static_cast<qint64>(dirOff) + 16 > rawSize)
+        return 0;
+    quint32 entries = qFromLittleEndian<quint16>(base + dirOff + 12) + qFromLittleEndian<quint16>(base + dirOff + 14);
+    int refs = 0;
+    for (quint32 i = 0; i < entries; i++) {
+        qint64 entryOff = dirOff + 16 + i * 8;
+        if (entryOff + 8 > rawSize)
+            break;
+        quint32 dataField = qFromLittleEndian<quint32>(base + entryOff + 4);
+        if ((dataField & hiMask) != 0)
+            refs += countRsrcDataRefs(raw, dataPtr, dataField & ~hiMask, depth + 1);
+        else if (static_cast<qint64>(dataField) + 16 <= rawSize && qFromLittleEndian<quint32>(base + dataField) == dataPtr)
+            refs++;
     }
-    if (!rsrcSec.isNull()) {
-        if (secMgr->addSection(rsrcSec))
-            // this can only fail if .rsrc already exists
-            // since we removed it earlier, assume the user just added their own .rsrc section
-            // and don't bother correcting the "old" one
-            correctOffsets(rsrcSec, rsrcSec->virtualAddr - oldRVA);
+    return refs;
+}
+
+static void collectRsrcDataEntries(const uchar *base, qint64 size, quint32 dirOff, QVector<quint32> *out, int depth = 0)
+{
+    if (depth > 32 || static_cast<qint64>(dirOff) + 16 > size)
+        return;
+    quint32 entries = qFromLittleEndian<quint16>(base + dirOff + 12) + qFromLittleEndian<quint16>(base + dirOff + 14);
+    for (quint32 i = 0; i < entries; i++) {
+        qint64 entryOff = dirOff + 16 + i * 8;
+        if (entryOff + 8 > size)
+            break;
+        quint32 dataField = qFromLittleEndian<quint32>(base + entryOff + 4);
+        if ((dataField & hiMask) != 0)
+            collectRsrcDataEntries(base, size, dataField & ~hiMask, out, depth + 1);
+        else if (static_cast<qint64>(dataField) + 16 <= size)
+            *out += dataField;
     }
-    return true;
+}
+
+QVector<quint32> QExeRsrcManager::dataEntryOffsets(const char *data, quint32 size, quint32 dirOff)
+{
+    QVector<quint32> ret;
+    collectRsrcDataEntries(reinterpret_cast<const uchar *>(data), size, dirOff, &ret);
+    // a description may be referenced more than once, but must only be reported once
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+void QExeRsrcManager::correctOffsets(QExeSectionPtr rsrcSec, const qint64 shift)
+{
+    QByteArray &raw = rsrcSec->rawData;
+    QVector<quint32> offsets = dataEntryOffsets(raw.constData(), static_cast<quint32>(raw.size()), 0);
+    char *base = raw.data();
+    foreach (quint32 offset, offsets)
+        qToLittleEndian<quint32>(qFromLittleEndian<quint32>(base + offset) + static_cast<quint32>(shift), base + offset);
+}
+
+bool QExeRsrcManager::addBeforeRsrcSection(QSharedPointer<QExeSectionManager> secMgr, QExeSectionPtr sec)
+{
+    QExeSectionPtr rsrcSec = secMgr->sectionAt(secMgr->rsrcSectionIndex());
+    if (rsrcSec.isNull())
+        return secMgr->addSection(sec);
+    // .rsrc (and anything after it) moves up, along with everything that points into it
+    return secMgr->insertSectionBefore(rsrcSec, sec);
 }
 
 QExeSectionPtr QExeRsrcManager::addBeforeRsrcSection(QSharedPointer<QExeSectionManager> secMgr, const QLatin1String &name, QByteArray data, QExeSection::Characteristics chars)
@@ -100,14 +401,106 @@ QExeSectionPtr QExeRsrcManager::addBeforeRsrcSection(QSharedPointer<QExeSectionM
     return newSec;
 }
 
+bool QExeRsrcManager::replaceData(QExeSectionPtr rsrcSec, const QString &path, const QByteArray &data, QExeErrorInfo *errinfo)
+{
+    if (rsrcSec.isNull()) {
+        SET_ERROR_INFO(BadRsrc_InvalidFormat)
+        return false;
+    }
+    return replaceData(rsrcSec, path, data, static_cast<quint32>(rsrcSec->rawData.size()), errinfo);
+}
+
+bool QExeRsrcManager::replaceData(QExe &exeDat, const QString &path, const QByteArray &data, QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    int rsrcI = secMgr->rsrcSectionIndex();
+    QExeSectionPtr rsrcSec = secMgr->sectionAt(rsrcI);
+    if (rsrcSec.isNull()) {
+        SET_ERROR_INFO(BadRsrc_InvalidFormat)
+        return false;
+    }
+    // the section may grow up until the next section starts
+    quint32 maxSize = std::numeric_limits<quint32>::max() - rsrcSec->virtualAddr;
+    for (int i = 0; i < secMgr->sectionCount(); i++) {
+        QExeSectionPtr section = secMgr->sectionAt(i);
+        if (section->virtualAddr > rsrcSec->virtualAddr)
+            maxSize = qMin(maxSize, section->virtualAddr - rsrcSec->virtualAddr);
+    }
+    quint32 size = QExe::alignForward(rsrcSec->virtualSize, exeDat.optionalHeader()->sectionAlign);
+    if (size > maxSize)
+        maxSize = size;
+    return replaceData(rsrcSec, path, data, maxSize, errinfo);
+}
+
+bool QExeRsrcManager::replaceData(QExeSectionPtr rsrcSec, const QString &path, const QByteArray &data, quint32 maxSize, QExeErrorInfo *errinfo)
+{
+    QVector<RsrcPathComponent> comps;
+    if (!parseRsrcPath(path, &comps)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadRsrc_EntryNotFound;
+            errinfo->details += path;
+        }
+        return false;
+    }
+    QByteArray &raw = rsrcSec->rawData;
+    quint32 descOff = findRsrcDataDesc(raw, comps);
+    if (descOff == 0) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadRsrc_EntryNotFound;
+            errinfo->details += path;
+        }
+        return false;
+    }
+    const quint32 newSize = static_cast<quint32>(data.size());
+    uchar *base = reinterpret_cast<uchar *>(raw.data());
+    quint32 oldPtr = qFromLittleEndian<quint32>(base + descOff);
+    quint32 oldSize = qFromLittleEndian<quint32>(base + descOff + 4);
+    quint32 oldSlot = QExe::alignForward(oldSize, rsrcDataAlign);
+    quint32 oldOff = oldPtr - rsrcSec->virtualAddr;
+    bool oldValid = oldPtr >= rsrcSec->virtualAddr && static_cast<qint64>(oldOff) + oldSlot <= raw.size();
+    // the old slot can't be touched if other entries still use it
+    if (oldValid && countRsrcDataRefs(raw, oldPtr, 0) > 1)
+        oldValid = false;
+    if (oldValid && newSize <= oldSlot) {
+        // fits in the old slot, overwrite it
+        memcpy(base + oldOff, data.constData(), newSize);
+        memset(base + oldOff + newSize, 0, oldSlot - newSize);
+        qToLittleEndian<quint32>(newSize, base + descOff + 4);
+        return true;
+    }
+    // doesn't fit, put it at the end of the section instead
+    quint32 newOff = QExe::alignForward(usedRsrcSize(raw, rsrcSec->virtualAddr, 0), rsrcDataAlign);
+    quint32 newEnd = newOff + newSize;
+    if (static_cast<qint64>(newOff) + newSize > maxSize) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadRsrc_InsufficientSpace;
+            errinfo->details += path;
+            errinfo->details += newEnd;
+        }
+        return false;
+    }
+    if (newEnd > static_cast<quint32>(raw.size())) {
+        raw.resize(static_cast<int>(QExe::alignForward(newEnd, rsrcDataAlign)));
+        if (rsrcSec->virtualSize < static_cast<quint32>(raw.size()))
+            rsrcSec->virtualSize = static_cast<quint32>(raw.size());
+        base = reinterpret_cast<uchar *>(raw.data());
+    }
+    memcpy(base + newOff, data.constData(), newSize);
+    if (oldValid)
+        memset(base + oldOff, 0, oldSlot);
+    qToLittleEndian<quint32>(rsrcSec->virtualAddr + newOff, base + descOff);
+    qToLittleEndian<quint32>(newSize, base + descOff + 4);
+    return true;
+}
+
 bool QExeRsrcManager::read(QExeSectionPtr sec, QExeErrorInfo *errinfo)
 {
     QBuffer buf(&sec->rawData);
     buf.open(QBuffer::ReadOnly);
     QDataStream ds(&buf);
     ds.setByteOrder(QDataStream::LittleEndian);
-    m_root->removeAllChildren();
-    if (!readDirectory(buf, ds, m_root, sec->virtualAddr)) {
+    resetArena();
+    if (!readDirectory(buf, ds, root(), sec->virtualAddr)) {
         SET_ERROR_INFO(BadRsrc_InvalidFormat)
         return false;
     }
@@ -115,89 +508,159 @@ bool QExeRsrcManager::read(QExeSectionPtr sec, QExeErrorInfo *errinfo)
     return true;
 }
 
-struct QExeRsrcManager::SectionSizes {
-public:
-    quint32 directorySize;
-    quint32 dataDescSize;
-    quint32 stringSize;
-    quint32 dataSize;
-    quint32 totalSize() {
-        return directorySize + dataDescSize + stringSize + dataSize;
-    }
-    SectionSizes& operator+=(const SectionSizes &other) {
-        directorySize += other.directorySize;
-        dataDescSize += other.dataDescSize;
-        stringSize += other.stringSize;
-        dataSize += other.dataSize;
-        return *this;
-    }
-};
+// trees with less data than this are serialized on the calling thread, since spinning up the pool isn't worth it
+static const qint64 rsrcParallelThreshold = 4 * 1024 * 1024;
 
-struct QExeRsrcManager::SymbolTable {
+struct QExeRsrcManager::Layout {
 public:
-    std::list<QExeRsrcEntryPtr> directories;
-    QHash<QExeRsrcEntryPtr, quint32> directoryOffs;
-    QHash<QExeRsrcEntryPtr, QList<qint64>> directoryRefs;
-    std::list<QExeRsrcEntryPtr> dataDescs;
-    QHash<QExeRsrcEntryPtr, QList<qint64>> dataDescRefs;
-    std::list<QString> strings;
-    QHash<QString, QList<qint64>> stringRefs;
-};
-
-struct QExeRsrcManager::SubdirStorage {
-public:
-    std::list<QExeRsrcEntryPtr> id;
-    std::list<QExeRsrcEntryPtr> name;
-
-    void add(QExeRsrcEntryPtr subdir) {
-        if (subdir->name.isEmpty())
-            id.push_back(subdir);
-        else
-            name.push_back(subdir);
-    }
-
-    bool empty() {
-        return id.empty() && name.empty();
-    }
-
-    void move(SubdirStorage &from) {
-        id = from.id;
-        from.id.clear();
-        name = from.name;
-        from.name.clear();
-    }
+    QVector<const QExeRsrcEntry *> directories; // breadth-first, root first
+    QVector<const QExeRsrcEntry *> dataEntries;
+    QVector<quint32> offsets; // arena index => offset of directory table/data description
+    QHash<QString, quint32> stringOffs;
+    QVector<const QExeRsrcEntry *> blobs; // entries with unique data
+    QVector<quint32> blobOffs;
+    QVector<int> dataBlobs; // data entry => index into blobs
+    quint32 stringStart;
+    quint32 dataStart;
+    quint32 totalSize;
+    qint64 dataBytes; // total size of all data entries, before deduplication
+    bool parallel() const { return dataBytes >= rsrcParallelThreshold; }
 };
 
 QExeSectionPtr QExeRsrcManager::toSection(quint32 sectionAlign)
 {
-    SymbolTable symTbl;
-    SectionSizes sizes = calculateSectionSizes(m_root);
-    quint32 size = QExe::alignForward(sizes.totalSize(), sectionAlign);
+    Layout layout;
+    layoutSection(layout);
+    quint32 size = QExe::alignForward(layout.totalSize, sectionAlign);
     QExeSectionPtr sec = QExeSectionPtr(new QExeSection(QLatin1String(".rsrc"), size,
                                                         QExeSection::ContainsInitializedData | QExeSection::IsReadable));
+    sec->rawData.fill(0);
+    writeSection(layout, sec->rawData.data());
+    return sec;
+}
 
-    QBuffer dst(&sec->rawData);
-    dst.open(QBuffer::WriteOnly);
-    QDataStream ds(&dst);
-    ds.setByteOrder(QDataStream::LittleEndian);
-    // write root directory
-    SubdirStorage subdirs;
-    writeDirectory(dst, ds, m_root, subdirs, symTbl);
-    // write subdirectories until we can't
-    SubdirStorage nextSubdirs;
-    QExeRsrcEntryPtr entry;
-    while (!subdirs.empty()) {
-        foreach (entry, subdirs.name)
-            writeDirectory(dst, ds, entry, nextSubdirs, symTbl);
-        foreach (entry, subdirs.id)
-            writeDirectory(dst, ds, entry, nextSubdirs, symTbl);
-        subdirs.move(nextSubdirs);
-    }
-    // write symbols
-    writeSymbols(dst, ds, sizes, symTbl);
-    dst.close();
+void QExeRsrcManager::layoutSection(Layout &layout)
+{
+    layout.offsets.resize(static_cast<int>(m_arena->entryCount));
+    layout.dataBytes = 0;
+    // directory tables
+    quint32 pos = 0;
+    layout.directories += entryAt(0);
+    for (int i = 0; i < layout.directories.size(); i++) {
+        QExeRsrcEntry *dir = const_cast<QExeRsrcEntry *>(layout.directories[i]);
+        // the PE spec requires entries to be in canonical order, directories that are already sorted are left alone
+        dir->sortChildren();
+        layout.offsets[static_cast<int>(dir->m_index)] = pos;
+        pos += 16 + static_cast<quint32>(dir->m_children.size()) * 8;
+        for (quint32 index : dir->m_children) {
+            const QExeRsrcEntry *entry = entryAt(index);
+            if (entry->m_type == QExeRsrcEntry::Directory)
+                layout.directories += entry;
+            else {
+                layout.dataEntries += entry;
+                layout.dataBytes += entry->data.size();
+            }
+        }
+    }
+    // data descriptions
+    for (const QExeRsrcEntry *entry : layout.dataEntries) {
+        layout.offsets[static_cast<int>(entry->m_index)] = pos;
+        pos += 16;
+    }
+    // strings, each unique name is only stored once
+    layout.stringStart = pos;
+    for (const QExeRsrcEntry *dir : layout.directories) {
+        for (quint32 index : dir->m_children) {
+            const QExeRsrcEntry *entry = entryAt(index);
+            if (entry->name.isEmpty() || layout.stringOffs.contains(entry->name))
+                continue;
+            layout.stringOffs.insert(entry->name, pos);
+            pos += 2 + static_cast<quint32>(entry->name.size()) * 2;
+        }
+    }
+    // data, identical blobs are only stored once
+    pos = QExe::alignForward(pos, rsrcDataAlign);
+    layout.dataStart = pos;
+    // hashing touches every byte, so do it up front (and in parallel for large trees)
+    QVector<uint> hashes(layout.dataEntries.size());
+    QExeConcurrent::forEachIndex(layout.dataEntries.size(), layout.parallel(), [&layout, &hashes](int i) {
+        hashes[i] = qHash(layout.dataEntries[i]->data);
+    });
+    QHash<uint, QVector<int>> blobsByHash;
+    layout.dataBlobs.reserve(layout.dataEntries.size());
+    for (int i = 0; i < layout.dataEntries.size(); i++) {
+        const QExeRsrcEntry *entry = layout.dataEntries[i];
+        QVector<int> &candidates = blobsByHash[hashes[i]];
+        int blob = -1;
+        for (int candidate : candidates) {
+            const QByteArray &other = layout.blobs[candidate]->data;
+            if (other.constData() == entry->data.constData() || other == entry->data) {
+                blob = candidate;
+                break;
+            }
+        }
+        if (blob < 0) {
+            blob = layout.blobs.size();
+            candidates += blob;
+            layout.blobs += entry;
+            layout.blobOffs += pos;
+            pos += QExe::alignForward(static_cast<quint32>(entry->data.size()), rsrcDataAlign);
+        }
+        layout.dataBlobs += blob;
+    }
+    layout.totalSize = pos;
+}
 
-    return sec;
+void QExeRsrcManager::writeSection(const Layout &layout, char *dst)
+{
+    // directory tables
+    for (const QExeRsrcEntry *dir : layout.directories) {
+        char *out = dst + layout.offsets[static_cast<int>(dir->m_index)];
+        qToLittleEndian<quint32>(dir->directoryMeta.characteristics, out);
+        qToLittleEndian<quint32>(dir->directoryMeta.timestamp, out + 4);
+        qToLittleEndian<quint16>(dir->directoryMeta.version.first, out + 8);
+        qToLittleEndian<quint16>(dir->directoryMeta.version.second, out + 10);
+        quint16 entryCountName = 0, entryCountID = 0;
+        out += 16;
+        for (quint32 index : dir->m_children) {
+            const QExeRsrcEntry *entry = entryAt(index);
+            if (entry->name.isEmpty()) {
+                entryCountID++;
+                qToLittleEndian<quint32>(entry->id, out);
+            } else {
+                entryCountName++;
+                qToLittleEndian<quint32>(layout.stringOffs.value(entry->name) | hiMask, out);
+            }
+            quint32 off = layout.offsets[static_cast<int>(index)];
+            if (entry->m_type == QExeRsrcEntry::Directory)
+                off |= hiMask;
+            qToLittleEndian<quint32>(off, out + 4);
+            out += 8;
+        }
+        out = dst + layout.offsets[static_cast<int>(dir->m_index)];
+        qToLittleEndian<quint16>(entryCountName, out + 12);
+        qToLittleEndian<quint16>(entryCountID, out + 14);
+    }
+    // data descriptions
+    for (int i = 0; i < layout.dataEntries.size(); i++) {
+        const QExeRsrcEntry *entry = layout.dataEntries[i];
+        char *out = dst + layout.offsets[static_cast<int>(entry->m_index)];
+        qToLittleEndian<quint32>(layout.blobOffs[layout.dataBlobs[i]], out);
+        qToLittleEndian<quint32>(static_cast<quint32>(entry->data.size()), out + 4);
+        qToLittleEndian<quint32>(entry->dataMeta.codepage, out + 8);
+        qToLittleEndian<quint32>(entry->dataMeta.reserved, out + 12);
+    }
+    // strings
+    for (auto it = layout.stringOffs.constBegin(); it != layout.stringOffs.constEnd(); ++it) {
+        char *out = dst + it.value();
+        qToLittleEndian<quint16>(static_cast<quint16>(it.key().size()), out);
+        QExeUtf16::toLE(it.key(), out + 2);
+    }
+    // data, every blob has its own range of dst so they can be copied independently
+    QExeConcurrent::forEachIndex(layout.blobs.size(), layout.parallel(), [&layout, dst](int i) {
+        const QByteArray &data = layout.blobs[i]->data;
+        memcpy(dst + layout.blobOffs[i], data.constData(), static_cast<size_t>(data.size()));
+    });
 }
 
 bool QExeRsrcManager::toSection(QExe &exeDat)
@@ -209,6 +672,240 @@ bool QExeRsrcManager::toSection(QExe &exeDat)
     return true;
 }
 
+// file and directory names for importDirectory/exportDirectory: numeric names are IDs, anything else is a name
+// only the canonical form of a number counts, as "010" and "10" would otherwise both be ID 10
+static bool rsrcFileNumeric(const QString &part)
+{
+    if (part.isEmpty())
+        return false;
+    for (const QChar &c : part) {
+        if (c.unicode() < '0' || c.unicode() > '9')
+            return false;
+    }
+    return true;
+}
+
+static bool rsrcFileComponent(const QString &part, RsrcPathComponent *comp)
+{
+    comp->isID = false;
+    comp->id = 0;
+    comp->name.clear();
+    if (!rsrcFileNumeric(part)) {
+        comp->name = part;
+        return true;
+    }
+    if (part.size() > 1 && part.at(0) == QLatin1Char('0'))
+        return false;
+    comp->id = part.toUInt(&comp->isID, 10);
+    return comp->isID;
+}
+
+static bool rsrcFileNameValid(const QString &name)
+{
+    if (name == QLatin1String(".") || name == QLatin1String("..")
+            || name.contains(QLatin1Char('/')) || name.contains(QLatin1Char('\\')))
+        return false;
+    // would be read back as an ID, or not at all
+    return !rsrcFileNumeric(name);
+}
+
+struct RsrcImportFile {
+    QString filePath;
+    QVector<RsrcPathComponent> path;
+    QByteArray data;
+    bool ok;
+};
+
+struct RsrcExportFile {
+    QString filePath;
+    const QExeRsrcEntry *entry;
+    bool ok;
+};
+
+static bool rsrcComponentEquals(const RsrcPathComponent &comp1, const RsrcPathComponent &comp2)
+{
+    return comp1.isID == comp2.isID && (comp1.isID ? comp1.id == comp2.id : comp1.name == comp2.name);
+}
+
+static bool rsrcComponentsLess(const QVector<RsrcPathComponent> &path1, const QVector<RsrcPathComponent> &path2)
+{
+    const int len = qMin(path1.size(), path2.size());
+    for (int i = 0; i < len; i++) {
+        const RsrcPathComponent &comp1 = path1[i], &comp2 = path2[i];
+        if (comp1.isID != comp2.isID)
+            return comp2.isID;
+        int cmp = comp1.isID ? (comp1.id < comp2.id ? -1 : (comp1.id > comp2.id ? 1 : 0))
+                             : QExeRsrcEntry::compareNames(comp1.name, comp2.name);
+        if (cmp != 0)
+            return cmp < 0;
+    }
+    return path1.size() < path2.size();
+}
+
+bool QExeRsrcManager::importDirectory(const QString &dirPath, QExeErrorInfo *errinfo)
+{
+    QDir dir(dirPath);
+    if (!dir.exists()) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadIODevice_Unreadable;
+            errinfo->details += dirPath;
+        }
+        return false;
+    }
+    QVector<RsrcImportFile> files;
+    QDirIterator it(dir.absolutePath(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        RsrcImportFile file;
+        file.filePath = it.next();
+        bool valid = true;
+        foreach (const QString &part, dir.relativeFilePath(file.filePath).split(QLatin1Char('/'), Qt::SkipEmptyParts)) {
+            RsrcPathComponent comp;
+            valid = valid && rsrcFileComponent(part, &comp);
+            file.path += comp;
+        }
+        // the root directory only holds type directories
+        if (!valid || file.path.size() < 2) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadRsrc_InvalidFormat;
+                errinfo->details += file.filePath;
+            }
+            return false;
+        }
+        file.ok = false;
+        files += file;
+    }
+    // read everything up front, so a missing file doesn't leave the tree half-updated
+    QExeConcurrent::forEachIndex(files.size(), true, [&files](int i) {
+        QFile src(files[i].filePath);
+        if (!src.open(QFile::ReadOnly))
+            return;
+        files[i].data = src.readAll();
+        files[i].ok = src.error() == QFile::NoError;
+    });
+    foreach (const RsrcImportFile &file, files) {
+        if (!file.ok) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadIODevice_Unreadable;
+                errinfo->details += file.filePath;
+            }
+            return false;
+        }
+    }
+    // adding entries in canonical order keeps every directory sorted, and lets consecutive files reuse their parents
+    std::sort(files.begin(), files.end(), [](const RsrcImportFile &file1, const RsrcImportFile &file2) {
+        return rsrcComponentsLess(file1.path, file2.path);
+    });
+    // check every path against the tree before changing anything, so a conflict doesn't leave it half-updated either
+    for (int f = 0; f < files.size(); f++) {
+        const RsrcImportFile &file = files[f];
+        bool conflict = false;
+        // a file can't be a directory of another file too, and those would sort right after it
+        if (f + 1 < files.size() && files[f + 1].path.size() > file.path.size()) {
+            conflict = true;
+            for (int i = 0; i < file.path.size() && conflict; i++)
+                conflict = rsrcComponentEquals(file.path[i], files[f + 1].path[i]);
+        }
+        QExeRsrcEntryPtr entry = root();
+        for (int i = 0; i < file.path.size() && !conflict && !entry.isNull(); i++) {
+            const RsrcPathComponent &comp = file.path[i];
+            entry = comp.isID ? entry->child(comp.id) : entry->child(comp.name);
+            if (!entry.isNull())
+                conflict = entry->type() != (i < file.path.size() - 1 ? QExeRsrcEntry::Directory : QExeRsrcEntry::Data);
+        }
+        if (conflict) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadRsrc_InvalidFormat;
+                errinfo->details += file.filePath;
+            }
+            return false;
+        }
+    }
+    QVector<QExeRsrcEntryPtr> dirs;
+    dirs += root();
+    QVector<RsrcPathComponent> prevPath;
+    for (RsrcImportFile &file : files) {
+        const int dirDepth = file.path.size() - 1;
+        int common = 0;
+        while (common < dirDepth && common < prevPath.size() - 1 && rsrcComponentEquals(file.path[common], prevPath[common]))
+            common++;
+        dirs.resize(common + 1);
+        for (int i = common; i <= dirDepth; i++) {
+            const RsrcPathComponent &comp = file.path[i];
+            QExeRsrcEntry::Type type = i < dirDepth ? QExeRsrcEntry::Directory : QExeRsrcEntry::Data;
+            QExeRsrcEntryPtr entry = comp.isID ? dirs.last()->createChildIfAbsent(type, comp.id)
+                                               : dirs.last()->createChildIfAbsent(type, comp.name);
+            if (type == QExeRsrcEntry::Directory)
+                dirs += entry;
+            else
+                entry->data = file.data;
+        }
+        prevPath = file.path;
+    }
+    return true;
+}
+
+bool QExeRsrcManager::exportDirectory(const QString &dirPath, QExeErrorInfo *errinfo) const
+{
+    QDir dir(dirPath);
+    QVector<RsrcExportFile> files;
+    QStringList dirs;
+    dirs += QStringLiteral(".");
+    QVector<QPair<const QExeRsrcEntry *, QString>> pending;
+    pending += qMakePair(static_cast<const QExeRsrcEntry *>(entryAt(0)), QString());
+    while (!pending.isEmpty()) {
+        QPair<const QExeRsrcEntry *, QString> cur = pending.takeLast();
+        for (quint32 index : cur.first->m_children) {
+            const QExeRsrcEntry *entry = entryAt(index);
+            if (!entry->name.isEmpty() && !rsrcFileNameValid(entry->name)) {
+                if (errinfo != nullptr) {
+                    errinfo->errorID = QExeErrorInfo::BadRsrc_InvalidFormat;
+                    errinfo->details += entry->path();
+                }
+                return false;
+            }
+            QString path = entry->name.isEmpty() ? QString::number(entry->id) : entry->name;
+            if (!cur.second.isEmpty())
+                path = cur.second + QLatin1Char('/') + path;
+            if (entry->m_type == QExeRsrcEntry::Directory) {
+                dirs += path;
+                pending += qMakePair(entry, path);
+            } else {
+                RsrcExportFile file;
+                file.filePath = dir.filePath(path);
+                file.entry = entry;
+                file.ok = false;
+                files += file;
+            }
+        }
+    }
+    foreach (const QString &path, dirs) {
+        if (!dir.mkpath(path)) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadIODevice_Unwritable;
+                errinfo->details += dir.filePath(path);
+            }
+            return false;
+        }
+    }
+    QExeConcurrent::forEachIndex(files.size(), true, [&files](int i) {
+        QFile dst(files[i].filePath);
+        if (!dst.open(QFile::WriteOnly | QFile::Truncate))
+            return;
+        const QByteArray &data = files[i].entry->data;
+        files[i].ok = dst.write(data) == data.size();
+    });
+    foreach (const RsrcExportFile &file, files) {
+        if (!file.ok) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadIODevice_Unwritable;
+                errinfo->details += file.filePath;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
 bool QExeRsrcManager::readDirectory(QBuffer &src, QDataStream &ds, QExeRsrcEntryPtr dir, quint32 offset) {
     ds >> dir->directoryMeta.characteristics;
     ds >> dir->directoryMeta.timestamp;
@@ -227,7 +924,7 @@ bool QExeRsrcManager::readDirectory(QBuffer &src, QDataStream &ds, QExeRsrcEntry
 
 bool QExeRsrcManager::readEntry(QBuffer &src, QDataStream &ds, QExeRsrcEntryPtr entry, quint32 offset)
 {
-    QExeRsrcEntryPtr child = QExeRsrcEntryPtr(new QExeRsrcEntry(QExeRsrcEntry::Data));
+    QExeRsrcEntryPtr child = QExeRsrcEntryPtr(m_arena->allocate(QExeRsrcEntry::Data));
 
     quint32 nameOff;
     ds >> nameOff;
@@ -235,22 +932,22 @@ bool QExeRsrcManager::readEntry(QBuffer &src, QDataStream &ds, QExeRsrcEntryPtr
     ds >> dataOff;
 
     // read name/ID
-    qint64 prevPos = src.pos();
     if ((nameOff & hiMask) == 0)
         // id
         child->id = nameOff;
     else {
         // name
         nameOff &= ~hiMask;
-        src.seek(nameOff);
-        quint16 nameLen;
-        ds >> nameLen;
-        QByteArray nameBytes = src.read(nameLen * 2);
-        child->name = QTextCodec::codecForName("UTF-16LE")->makeDecoder(QTextCodec::IgnoreHeader)->toUnicode(nameBytes);
-        src.seek(prevPos);
+        const QByteArray &raw = src.buffer();
+        if (static_cast<qint64>(nameOff) + 2 > raw.size())
+            return false;
+        quint16 nameLen = qFromLittleEndian<quint16>(raw.constData() + nameOff);
+        if (static_cast<qint64>(nameOff) + 2 + nameLen * 2 > raw.size())
+            return false;
+        child->name = QExeUtf16::fromLE(raw.constData() + nameOff + 2, nameLen);
     }
     // read data/directory
-    prevPos = src.pos();
+    qint64 prevPos = src.pos();
     if ((dataOff & hiMask) == 0) {
         // data
         src.seek(dataOff);
@@ -264,152 +961,17 @@ bool QExeRsrcManager::readEntry(QBuffer &src, QDataStream &ds, QExeRsrcEntryPtr
         child->data = src.read(dataSize);
     } else {
         // directory
+        // add it before reading its children, so they can be checked against the index
         dataOff &= ~hiMask;
         child->m_type = QExeRsrcEntry::Directory;
+        if (!entry->addChild(child))
+            return false;
         src.seek(dataOff);
         if (!readDirectory(src, ds, child, offset))
             return false;
+        src.seek(prevPos);
+        return true;
     }
     src.seek(prevPos);
     return entry->addChild(child);
 }
-
-const quint32 rsrcDataAlign = 4; // .rsrc data is aligned to DWORD boundary
-
-QExeRsrcManager::SectionSizes QExeRsrcManager::calculateSectionSizes(QExeRsrcEntryPtr root, QStringList *allocStr)
-{
-    if (allocStr == nullptr)
-        allocStr = new QStringList();
-    SectionSizes sz;
-    sz.directorySize = 0x10;
-    sz.dataDescSize = 0;
-    sz.stringSize = 0;
-    sz.dataSize = 0;
-    QExeRsrcEntryPtr entry;
-    foreach (entry, root->children()) {
-        sz.directorySize += 0x10;
-        if (!entry->name.isEmpty() && !allocStr->contains(entry->name)) {
-            allocStr->append(entry->name);
-            sz.stringSize += 2 + static_cast<quint32>(entry->name.size()) * 2;
-        }
-        if (entry->type() == QExeRsrcEntry::Data) {
-            sz.dataDescSize += 0x10;
-            sz.dataSize += QExe::alignForward(static_cast<quint32>(entry->data.size()), rsrcDataAlign);
-        } else {
-            SectionSizes other = calculateSectionSizes(entry, allocStr);
-            sz += other;
-        }
-    }
-    return sz;
-}
-
-void QExeRsrcManager::writeDirectory(QBuffer &dst, QDataStream &ds, QExeRsrcEntryPtr dir, QExeRsrcManager::SubdirStorage &subdirs, QExeRsrcManager::SymbolTable &symTbl)
-{
-    symTbl.directories.push_back(dir);
-    symTbl.directoryOffs[dir] = static_cast<quint32>(dst.pos());
-    // write unimportant stuff
-    ds << dir->directoryMeta.characteristics;
-    ds << dir->directoryMeta.timestamp;
-    ds << dir->directoryMeta.version;
-    // count entries, save subdirectories for later
-    quint16 entryCountName = 0, entryCountID = 0;
-    std::list<QExeRsrcEntryPtr> entriesID, entriesName;
-    QExeRsrcEntryPtr entry;
-    foreach (entry, dir->children()) {
-        if (entry->name.isEmpty()) {
-            entryCountID++;
-            entriesID.push_back(entry);
-        } else {
-            entryCountName++;
-            entriesName.push_back(entry);
-        }
-        if (entry->type() == QExeRsrcEntry::Directory)
-            subdirs.add(entry);
-    }
-    // write entry counts
-    ds << entryCountName;
-    ds << entryCountID;
-    // write entries
-    writeEntries(dst, ds, entriesName, symTbl);
-    writeEntries(dst, ds, entriesID, symTbl);
-}
-
-void QExeRsrcManager::writeEntries(QBuffer &dst, QDataStream &ds, std::list<QExeRsrcEntryPtr> &entries, QExeRsrcManager::SymbolTable &symTbl)
-{
-    QExeRsrcEntryPtr entry;
-    foreach (entry, entries) {
-        if (entry->name.isEmpty())
-            ds << entry->id;
-        else {
-            symTbl.strings.push_back(entry->name);
-            symTbl.stringRefs[entry->name] += dst.pos();
-            ds << hiMask;
-        }
-        if (entry->type() == QExeRsrcEntry::Directory) {
-            symTbl.directoryRefs[entry] += dst.pos();
-            ds << hiMask;
-        } else {
-            symTbl.dataDescs.push_back(entry);
-            symTbl.dataDescRefs[entry] += dst.pos();
-            ds << static_cast<quint32>(0);
-            ds << static_cast<quint32>(entry->data.size());
-            ds << entry->dataMeta.codepage;
-            ds << entry->dataMeta.reserved;
-        }
-    }
-}
-
-void QExeRsrcManager::writeSymbols(QBuffer &dst, QDataStream &ds, const QExeRsrcManager::SectionSizes &sizes, QExeRsrcManager::SymbolTable &symTbl)
-{
-    // write directroy references
-    QExeRsrcEntryPtr entry;
-    foreach (entry, symTbl.directories) {
-        quint32 v = symTbl.directoryOffs[entry] | hiMask;
-        qint64 pos;
-        foreach (pos, symTbl.directoryRefs[entry]) {
-            dst.seek(pos);
-            ds << v;
-        }
-    }
-    // write actual data, remember offsets
-    QMap<QExeRsrcEntryPtr, quint32> dataPtrs;
-    dst.seek(sizes.directorySize + sizes.dataDescSize + sizes.stringSize);
-    QExeRsrcEntryPtr dataDesc;
-    foreach (dataDesc, symTbl.dataDescs) {
-        dataPtrs[dataDesc] = static_cast<quint32>(dst.pos());
-        dst.write(dataDesc->data);
-        dst.seek(QExe::alignForward(static_cast<quint32>(dst.pos()), rsrcDataAlign));
-    }
-    // write data descriptions and their references
-    dst.seek(sizes.directorySize);
-    foreach (dataDesc, symTbl.dataDescs) {
-        quint32 prevPos = static_cast<quint32>(dst.pos());
-        qint64 pos;
-        foreach (pos, symTbl.dataDescRefs[dataDesc]) {
-            dst.seek(pos);
-            ds << prevPos;
-        }
-        dst.seek(prevPos);
-        quint32 dataPtr = dataPtrs[dataDesc];
-        ds << dataPtr;
-        ds << static_cast<quint32>(dataDesc->data.size());
-        ds << dataDesc->dataMeta.codepage;
-        ds << dataDesc->dataMeta.reserved;
-    }
-    // write strings and their references
-    QTextEncoder *encoder = QTextCodec::codecForName("UTF-16LE")->makeEncoder(QTextCodec::IgnoreHeader);
-    dst.seek(sizes.directorySize + sizes.dataDescSize);
-    QString str;
-    foreach (str, symTbl.strings) {
-        quint32 prevPos = static_cast<quint32>(dst.pos());
-        quint32 v = prevPos | hiMask;
-        qint64 pos;
-        foreach (pos, symTbl.stringRefs[str]) {
-            dst.seek(pos);
-            ds << v;
-        }
-        dst.seek(prevPos);
-        ds << static_cast<quint16>(str.size());
-        dst.write(encoder->fromUnicode(str));
-    }
-}
@@ -2,45 +2,89 @@
 #define QEXERSRCMANAGER_H
 
 #include <QObject>
+#include <QHash>
 
 #include "QExe_global.h"
 #include "qexesection.h"
 #include "qexeerrorinfo.h"
 #include "qexersrcentry.h"
+#include "qexersrcquery.h"
 
 class QBuffer;
 class QExe;
+class QExeRsrcArena;
 
 class QEXE_EXPORT QExeRsrcManager : public QObject
 {
     Q_OBJECT
 public:
     explicit QExeRsrcManager(QObject *parent = nullptr);
+    ~QExeRsrcManager();
 
+    // starts over with a new tree, entries of the old one stay alive for as long as handles to them exist
     bool read(QExeSectionPtr sec, QExeErrorInfo *errinfo = nullptr);
     QExeSectionPtr toSection(quint32 sectionAlign);
     bool toSection(QExe &exeDat);
 
+    // one file per data entry (e.g. "<dir>/3/MAINICON/1033"), numeric file and directory names are IDs
+    // importing adds missing entries and replaces the data of existing ones
+    // nothing changes if a file can't be read, if it's right in dirPath (outside of a type directory), if a numeric
+    // name has leading zeros or is out of range, or if an entry of the other type is in the way
+    bool importDirectory(const QString &dirPath, QExeErrorInfo *errinfo = nullptr);
+    bool exportDirectory(const QString &dirPath, QExeErrorInfo *errinfo = nullptr) const;
+
     QExeRsrcEntryPtr root() const;
 
+    QVector<QExeRsrcEntryPtr> find(const QExeRsrcQuery &query) const;
+    QVector<QExeRsrcEntryPtr> find(const QString &pattern) const;
+    QExeRsrcEntryPtr findFirst(const QExeRsrcQuery &query) const;
+
     static void correctOffsets(QExeSectionPtr rsrcSec, const qint64 shift);
 
     static bool addBeforeRsrcSection(QSharedPointer<QExeSectionManager> secMgr, QExeSectionPtr sec);
     static QExeSectionPtr addBeforeRsrcSection(QSharedPointer<QExeSectionManager> secMgr, const QLatin1String &name, QByteArray data, QExeSection::Characteristics chars);
     static QExeSectionPtr addBeforeRsrcSection(QSharedPointer<QExeSectionManager> secMgr, const QLatin1String &name, quint32 size, QExeSection::Characteristics chars);
+
+    static bool replaceData(QExeSectionPtr rsrcSec, const QString &path, const QByteArray &data, QExeErrorInfo *errinfo = nullptr);
+    static bool replaceData(QExe &exeDat, const QString &path, const QByteArray &data, QExeErrorInfo *errinfo = nullptr);
 private:
+    friend class QExeRsrcEntry;
+    friend class QExeRsrcDiff;
+    friend class QExeRVARewriter;
+
+    // the current generation of entries, see QExeRsrcEntryPtr for how long the others live
+    QExeRsrcArena *m_arena;
+    QExeRsrcEntry *entryAt(quint32 index) const;
+    void resetArena();
+
+    struct IndexKey {
+        quint32 parent;
+        quint32 id;
+        QString name;
+        bool operator==(const IndexKey &other) const {
+            return parent == other.parent && id == other.id && name == other.name;
+        }
+        friend uint qHash(const IndexKey &key, uint seed = 0) {
+            return qHash(key.parent, seed) ^ qHash(key.id, seed) ^ qHash(key.name, seed);
+        }
+    };
+    // (parent, ID/name) => child, for every entry in the tree
+    QHash<IndexKey, QExeRsrcEntry *> m_index;
+    void indexEntry(QExeRsrcEntry *entry);
+    void unindexEntry(QExeRsrcEntry *entry);
+    QExeRsrcEntryPtr indexedChild(quint32 parent, quint32 id) const;
+    QExeRsrcEntryPtr indexedChild(quint32 parent, const QString &name) const;
+    bool matchQuery(const QExeRsrcQuery &query, int depth, const QExeRsrcEntry *dir, QVector<QExeRsrcEntryPtr> *out, bool firstOnly) const;
+
     bool readDirectory(QBuffer &src, QDataStream &ds, QExeRsrcEntryPtr dir, quint32 offset);
     bool readEntry(QBuffer &src, QDataStream &ds, QExeRsrcEntryPtr entry, quint32 offset);
-    struct SectionSizes;
-    SectionSizes calculateSectionSizes(QExeRsrcEntryPtr root, QStringList *allocStr = nullptr);
-    struct SubdirStorage;
-    struct SymbolTable;
-    QExeRsrcEntryPtr m_root;
-    void writeDirectory(QBuffer &dst, QDataStream &ds, QExeRsrcEntryPtr dir, SubdirStorage &subdirs, SymbolTable &symTbl);
-    void writeEntries(QBuffer &dst, QDataStream &ds, std::list<QExeRsrcEntryPtr> &entries, SymbolTable &symTbl);
-    void writeSymbols(QBuffer &dst, QDataStream &ds, const QExeRsrcManager::SectionSizes &sizes, QExeRsrcManager::SymbolTable &symTbl);
-
-    static void shiftDirectory(QBuffer &buf, QDataStream &ds, const qint64 shift, const quint32 ptr);
+    struct Layout;
+    void layoutSection(Layout &layout);
+    void writeSection(const Layout &layout, char *dst);
+
+    // offsets of every data description in the directory tree at data + dirOff, relative to data
+    static QVector<quint32> dataEntryOffsets(const char *data, quint32 size, quint32 dirOff);
+    static bool replaceData(QExeSectionPtr rsrcSec, const QString &path, const QByteArray &data, quint32 maxSize, QExeErrorInfo *errinfo);
 };
 
 #endif // QEXERSRCMANAGER_H
@@ -0,0 +1,73 @@
+#include "qexersrcquery.h"
+
+#include <QMetaEnum>
+#include <QStringList>
+
+#include "qexersrcentry.h"
+
+static bool parseID(const QStringRef &str, quint32 *id)
+{
+    if (str.isEmpty())
+        return false;
+    bool ok = false;
+    *id = str.toUInt(&ok, 10);
+    return ok;
+}
+
+QExeRsrcQuery::QExeRsrcQuery()
+{
+    m_valid = false;
+}
+
+QExeRsrcQuery::QExeRsrcQuery(const QString &pattern)
+{
+    m_pattern = pattern;
+    m_valid = false;
+    const QStringList parts = pattern.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    if (parts.isEmpty())
+        return;
+    QMetaEnum rootDirMeta = QMetaEnum::fromType<QExeRsrcEntry::RootDirectory>();
+    m_components.reserve(parts.size());
+    for (int i = 0; i < parts.size(); i++) {
+        const QString &part = parts[i];
+        Component comp;
+        comp.kind = Component::Name;
+        comp.id = 0;
+        if (part == QLatin1String("*"))
+            comp.kind = Component::Any;
+        else if ((part.startsWith(QLatin1Char('*')) || part.startsWith(QLatin1Char('#'))) && parseID(part.midRef(1), &comp.id))
+            comp.kind = Component::ID;
+        else if (parseID(part.midRef(0), &comp.id))
+            comp.kind = Component::ID;
+        else {
+            comp.name = part;
+            if (i == 0) {
+                QByteArray key = part.toLatin1();
+                for (int j = 0; j < rootDirMeta.keyCount(); j++) {
+                    if (qstricmp(key.constData(), rootDirMeta.key(j)) == 0) {
+                        comp.kind = Component::NameOrID;
+                        comp.id = static_cast<quint32>(rootDirMeta.value(j));
+                        break;
+                    }
+                }
+            }
+        }
+        m_components += comp;
+    }
+    m_valid = true;
+}
+
+bool QExeRsrcQuery::isValid() const
+{
+    return m_valid;
+}
+
+QString QExeRsrcQuery::pattern() const
+{
+    return m_pattern;
+}
+
+int QExeRsrcQuery::depth() const
+{
+    return m_components.size();
+}
@@ -0,0 +1,44 @@
+#ifndef QEXERSRCQUERY_H
+#define QEXERSRCQUERY_H
+
+#include "QExe_global.h"
+
+#include <QString>
+#include <QVector>
+
+class QExeRsrcManager;
+
+// compiled form of a resource path pattern, such as "/3/*/1033" or "/RCDATA/CONFIG/*"
+// each component may be:
+//  "*" - matches any entry
+//  "*<id>", "#<id>" or "<id>" - matches the entry with that ID
+//  (first component only) a QExeRsrcEntry::RootDirectory key - matches that ID or an entry with that name
+//  anything else - matches the entry with that name
+class QEXE_EXPORT QExeRsrcQuery
+{
+public:
+    QExeRsrcQuery();
+    explicit QExeRsrcQuery(const QString &pattern);
+    bool isValid() const;
+    QString pattern() const;
+    int depth() const;
+private:
+    friend class QExeRsrcManager;
+
+    struct Component {
+        enum Kind {
+            Any,
+            ID,
+            Name,
+            NameOrID
+        };
+        Kind kind;
+        quint32 id;
+        QString name;
+    };
+    QString m_pattern;
+    QVector<Component> m_components;
+    bool m_valid;
+};
+
+#endif // QEXERSRCQUERY_H
@@ -0,0 +1,157 @@
+#include "qexersrcstringtable.h"
+
+#include <QtEndian>
+#include <QMap>
+#include <QVector>
+
+#include "qexeutf16_p.h"
+
+QExeRsrcStringTable::QExeRsrcStringTable()
+{
+    m_valid = false;
+}
+
+QExeRsrcStringTable::QExeRsrcStringTable(const QByteArray &data)
+{
+    m_data = data;
+    m_valid = false;
+    // only the length prefixes are read here, so string(index) doesn't have to walk the bundle
+    const char *base = m_data.constData();
+    const qint64 size = m_data.size();
+    qint64 pos = 0;
+    for (int i = 0; i < StringsPerBundle; i++) {
+        if (pos + 2 > size)
+            return;
+        m_lengths[i] = qFromLittleEndian<quint16>(base + pos);
+        m_offsets[i] = static_cast<quint32>(pos + 2);
+        pos += 2 + static_cast<qint64>(m_lengths[i]) * 2;
+        if (pos > size)
+            return;
+    }
+    m_valid = true;
+}
+
+bool QExeRsrcStringTable::isValid() const
+{
+    return m_valid;
+}
+
+int QExeRsrcStringTable::length(int index) const
+{
+    if (!m_valid || index < 0 || index >= StringsPerBundle)
+        return 0;
+    return m_lengths[index];
+}
+
+QString QExeRsrcStringTable::string(int index) const
+{
+    if (!m_valid || index < 0 || index >= StringsPerBundle)
+        return QString();
+    return QExeUtf16::fromLE(m_data.constData() + m_offsets[index], m_lengths[index]);
+}
+
+QStringList QExeRsrcStringTable::strings() const
+{
+    QStringList ret;
+    if (!m_valid)
+        return ret;
+    ret.reserve(StringsPerBundle);
+    for (int i = 0; i < StringsPerBundle; i++)
+        ret += string(i);
+    return ret;
+}
+
+quint32 QExeRsrcStringTable::bundleID(quint32 stringID)
+{
+    return stringID / StringsPerBundle + 1;
+}
+
+int QExeRsrcStringTable::bundleIndex(quint32 stringID)
+{
+    return static_cast<int>(stringID % StringsPerBundle);
+}
+
+QByteArray QExeRsrcStringTable::encode(const QStringList &strings)
+{
+    if (strings.size() > StringsPerBundle)
+        return QByteArray();
+    int size = StringsPerBundle * 2;
+    foreach (const QString &str, strings) {
+        if (str.size() > MaxStringLength)
+            return QByteArray();
+        size += str.size() * 2;
+    }
+    QByteArray ret(size, 0);
+    char *dst = ret.data();
+    for (int i = 0; i < strings.size(); i++) {
+        const QString &str = strings[i];
+        qToLittleEndian<quint16>(static_cast<quint16>(str.size()), dst);
+        QExeUtf16::toLE(str, dst + 2);
+        dst += 2 + str.size() * 2;
+    }
+    // the remaining strings are empty, and their length prefixes are already zeroed
+    return ret;
+}
+
+bool QExeRsrcStringTable::replaceStrings(QExeRsrcEntryPtr root, const QHash<quint32, QString> &strings, quint32 language, QExeErrorInfo *errinfo)
+{
+    if (root.isNull() || root->type() != QExeRsrcEntry::Directory) {
+        if (errinfo != nullptr)
+            errinfo->errorID = QExeErrorInfo::BadRsrc_InvalidFormat;
+        return false;
+    }
+    // group by bundle, so each bundle is only touched once
+    QMap<quint32, QVector<quint32>> bundles;
+    for (auto it = strings.constBegin(); it != strings.constEnd(); ++it)
+        bundles[bundleID(it.key())] += it.key();
+    // encode every bundle before changing anything
+    QExeRsrcEntryPtr tableDir = root->child(QExeRsrcEntry::StringTable);
+    QMap<quint32, QByteArray> encoded;
+    for (auto it = bundles.constBegin(); it != bundles.constEnd(); ++it) {
+        QStringList bundle;
+        QExeRsrcEntryPtr bundleDir = tableDir.isNull() ? nullptr : tableDir->child(it.key());
+        QExeRsrcEntryPtr langEntry = bundleDir.isNull() ? nullptr : bundleDir->child(language);
+        if ((!tableDir.isNull() && tableDir->type() != QExeRsrcEntry::Directory)
+                || (!bundleDir.isNull() && bundleDir->type() != QExeRsrcEntry::Directory)
+                || (!langEntry.isNull() && langEntry->type() != QExeRsrcEntry::Data)) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadRsrc_InvalidFormat;
+                errinfo->details += it.key();
+            }
+            return false;
+        }
+        if (!langEntry.isNull() && !langEntry->data.isEmpty()) {
+            QExeRsrcStringTable view(langEntry->data);
+            if (!view.isValid()) {
+                if (errinfo != nullptr) {
+                    errinfo->errorID = QExeErrorInfo::BadRsrc_InvalidFormat;
+                    errinfo->details += langEntry->path();
+                }
+                return false;
+            }
+            bundle = view.strings();
+        }
+        while (bundle.size() < StringsPerBundle)
+            bundle += QString();
+        foreach (quint32 stringID, it.value())
+            bundle[bundleIndex(stringID)] = strings.value(stringID);
+        QByteArray data = encode(bundle);
+        if (data.isNull()) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadRsrc_EncodeFailure;
+                errinfo->details += it.key();
+            }
+            return false;
+        }
+        encoded.insert(it.key(), data);
+    }
+    if (encoded.isEmpty())
+        return true;
+    tableDir = root->createChildIfAbsent(QExeRsrcEntry::Directory, QExeRsrcEntry::StringTable);
+    for (auto it = encoded.constBegin(); it != encoded.constEnd(); ++it) {
+        QExeRsrcEntryPtr bundleDir = tableDir->createChildIfAbsent(QExeRsrcEntry::Directory, it.key());
+        QExeRsrcEntryPtr langEntry = bundleDir->createChildIfAbsent(QExeRsrcEntry::Data, language);
+        langEntry->data = it.value();
+    }
+    return true;
+}
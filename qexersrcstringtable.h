@@ -0,0 +1,44 @@
+#ifndef QEXERSRCSTRINGTABLE_H
+#define QEXERSRCSTRINGTABLE_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+
+#include "qexeerrorinfo.h"
+#include "qexersrcentry.h"
+
+// view over a string table bundle (the data of a QExeRsrcEntry::StringTable entry)
+// a bundle holds 16 length-prefixed UTF-16LE strings: string ID n is string n % 16 of bundle n / 16 + 1
+// the view shares the bundle's bytes, strings are only decoded when asked for
+class QEXE_EXPORT QExeRsrcStringTable
+{
+public:
+    enum {
+        StringsPerBundle = 16,
+        MaxStringLength = 0xFFFF
+    };
+    QExeRsrcStringTable();
+    explicit QExeRsrcStringTable(const QByteArray &data);
+    bool isValid() const;
+    int length(int index) const;
+    QString string(int index) const;
+    QStringList strings() const;
+
+    static quint32 bundleID(quint32 stringID);
+    static int bundleIndex(quint32 stringID);
+    // missing strings are encoded as empty ones, returns a null QByteArray if strings can't be encoded
+    static QByteArray encode(const QStringList &strings);
+    // sets strings (string ID => string) in the given language, creating bundles as needed
+    // each affected bundle is decoded and re-encoded only once, and nothing is changed if any bundle fails
+    static bool replaceStrings(QExeRsrcEntryPtr root, const QHash<quint32, QString> &strings, quint32 language, QExeErrorInfo *errinfo = nullptr);
+private:
+    QByteArray m_data;
+    quint32 m_offsets[StringsPerBundle]; // offset of each string's characters
+    quint16 m_lengths[StringsPerBundle];
+    bool m_valid;
+};
+
+#endif // QEXERSRCSTRINGTABLE_H
@@ -0,0 +1,258 @@
+#include "qexersrcversioninfo.h"
+
+#include <QtEndian>
+
+#include "qexeutf16_p.h"
+
+static const quint32 fixedFileInfoSignature = 0xFEEF04BD;
+static const int fixedFileInfoSize = 13 * 4;
+
+// FixedFileInfo's fields, in on-disk order (after the signature)
+static quint32 QExeRsrcVersionInfo::FixedFileInfo::*const fixedFileInfoFields[] = {
+    &QExeRsrcVersionInfo::FixedFileInfo::structVersion,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileVersionMS,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileVersionLS,
+    &QExeRsrcVersionInfo::FixedFileInfo::productVersionMS,
+    &QExeRsrcVersionInfo::FixedFileInfo::productVersionLS,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileFlagsMask,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileFlags,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileOS,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileType,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileSubtype,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileDateMS,
+    &QExeRsrcVersionInfo::FixedFileInfo::fileDateLS
+};
+static const int fixedFileInfoFieldCount = sizeof(fixedFileInfoFields) / sizeof(fixedFileInfoFields[0]);
+
+static inline int alignDWord(int offset)
+{
+    return (offset + 3) & ~3;
+}
+
+QExeRsrcVersionInfo::QExeRsrcVersionInfo()
+{
+    m_valid = false;
+}
+
+QExeRsrcVersionInfo::QExeRsrcVersionInfo(const QByteArray &data)
+{
+    m_data = data;
+    m_valid = readNode(0, m_data.size(), &m_root) && keyEquals(m_root, QStringLiteral("VS_VERSION_INFO"));
+}
+
+bool QExeRsrcVersionInfo::isValid() const
+{
+    return m_valid;
+}
+
+bool QExeRsrcVersionInfo::hasFixedFileInfo() const
+{
+    return m_valid && m_root.valueSize >= fixedFileInfoSize
+            && qFromLittleEndian<quint32>(m_data.constData() + m_root.valueOffset) == fixedFileInfoSignature;
+}
+
+QExeRsrcVersionInfo::FixedFileInfo QExeRsrcVersionInfo::fixedFileInfo() const
+{
+    FixedFileInfo ret;
+    if (!hasFixedFileInfo()) {
+        for (int i = 0; i < fixedFileInfoFieldCount; i++)
+            ret.*fixedFileInfoFields[i] = 0;
+        return ret;
+    }
+    const char *src = m_data.constData() + m_root.valueOffset + 4;
+    for (int i = 0; i < fixedFileInfoFieldCount; i++)
+        ret.*fixedFileInfoFields[i] = qFromLittleEndian<quint32>(src + i * 4);
+    return ret;
+}
+
+QStringList QExeRsrcVersionInfo::stringTableKeys() const
+{
+    QStringList ret;
+    Node sfi;
+    if (!m_valid || !findChild(m_root, QStringLiteral("StringFileInfo"), &sfi))
+        return ret;
+    foreach (const Node &table, children(sfi))
+        ret += key(table);
+    return ret;
+}
+
+QString QExeRsrcVersionInfo::stringValue(const QString &key, const QString &tableKey) const
+{
+    Node sfi;
+    if (!m_valid || !findChild(m_root, QStringLiteral("StringFileInfo"), &sfi))
+        return QString();
+    foreach (const Node &table, children(sfi)) {
+        if (!tableKey.isEmpty() && !keyEquals(table, tableKey))
+            continue;
+        Node str;
+        if (findChild(table, key, &str))
+            return text(str);
+        if (tableKey.isEmpty())
+            break;
+    }
+    return QString();
+}
+
+QVector<QExeRsrcVersionInfo::StringTable> QExeRsrcVersionInfo::stringTables() const
+{
+    QVector<StringTable> ret;
+    Node sfi;
+    if (!m_valid || !findChild(m_root, QStringLiteral("StringFileInfo"), &sfi))
+        return ret;
+    foreach (const Node &tableNode, children(sfi)) {
+        StringTable table;
+        table.key = key(tableNode);
+        foreach (const Node &str, children(tableNode))
+            table.strings += qMakePair(key(str), text(str));
+        ret += table;
+    }
+    return ret;
+}
+
+QVector<quint32> QExeRsrcVersionInfo::translations() const
+{
+    QVector<quint32> ret;
+    Node vfi, var;
+    if (!m_valid || !findChild(m_root, QStringLiteral("VarFileInfo"), &vfi) || !findChild(vfi, QStringLiteral("Translation"), &var))
+        return ret;
+    const char *src = m_data.constData() + var.valueOffset;
+    for (int i = 0; i + 4 <= var.valueSize; i += 4)
+        ret += static_cast<quint32>(qFromLittleEndian<quint16>(src + i)) | (static_cast<quint32>(qFromLittleEndian<quint16>(src + i + 2)) << 16);
+    return ret;
+}
+
+// node header: length, value length, type, NUL-terminated key, then the DWORD-aligned value and children
+static int beginNode(QByteArray &dst, const QString &key, quint16 type, const char *value, int valueSize, quint16 valueLength)
+{
+    dst.append(alignDWord(dst.size()) - dst.size(), '\0');
+    const int start = dst.size();
+    const int keyEnd = start + 6 + (key.size() + 1) * 2;
+    const int valueOffset = alignDWord(keyEnd);
+    dst.resize(valueOffset + valueSize);
+    char *out = dst.data() + start;
+    qToLittleEndian<quint16>(0, out);
+    qToLittleEndian<quint16>(valueLength, out + 2);
+    qToLittleEndian<quint16>(type, out + 4);
+    QExeUtf16::toLE(key, out + 6);
+    memset(dst.data() + keyEnd - 2, 0, static_cast<size_t>(valueOffset - keyEnd + 2));
+    if (valueSize > 0)
+        memcpy(dst.data() + valueOffset, value, static_cast<size_t>(valueSize));
+    return start;
+}
+
+static void endNode(QByteArray &dst, int start)
+{
+    qToLittleEndian<quint16>(static_cast<quint16>(dst.size() - start), dst.data() + start);
+}
+
+QByteArray QExeRsrcVersionInfo::encode(const FixedFileInfo &fixed, const QVector<StringTable> &tables, const QVector<quint32> &translations)
+{
+    QByteArray ret;
+    char fixedData[fixedFileInfoSize];
+    qToLittleEndian<quint32>(fixedFileInfoSignature, fixedData);
+    for (int i = 0; i < fixedFileInfoFieldCount; i++)
+        qToLittleEndian<quint32>(fixed.*fixedFileInfoFields[i], fixedData + 4 + i * 4);
+    int root = beginNode(ret, QStringLiteral("VS_VERSION_INFO"), 0, fixedData, fixedFileInfoSize, fixedFileInfoSize);
+    if (!tables.isEmpty()) {
+        int sfi = beginNode(ret, QStringLiteral("StringFileInfo"), 1, nullptr, 0, 0);
+        foreach (const StringTable &table, tables) {
+            int tableStart = beginNode(ret, table.key, 1, nullptr, 0, 0);
+            for (const QPair<QString, QString> &str : table.strings) {
+                // text values are NUL-terminated, and their length is in characters
+                QByteArray value((str.second.size() + 1) * 2, 0);
+                QExeUtf16::toLE(str.second, value.data());
+                int strStart = beginNode(ret, str.first, 1, value.constData(), value.size(), static_cast<quint16>(str.second.size() + 1));
+                endNode(ret, strStart);
+            }
+            endNode(ret, tableStart);
+        }
+        endNode(ret, sfi);
+    }
+    if (!translations.isEmpty()) {
+        int vfi = beginNode(ret, QStringLiteral("VarFileInfo"), 1, nullptr, 0, 0);
+        QByteArray value(translations.size() * 4, 0);
+        for (int i = 0; i < translations.size(); i++) {
+            qToLittleEndian<quint16>(static_cast<quint16>(translations[i] & 0xFFFF), value.data() + i * 4);
+            qToLittleEndian<quint16>(static_cast<quint16>(translations[i] >> 16), value.data() + i * 4 + 2);
+        }
+        int var = beginNode(ret, QStringLiteral("Translation"), 0, value.constData(), value.size(), static_cast<quint16>(value.size()));
+        endNode(ret, var);
+        endNode(ret, vfi);
+    }
+    endNode(ret, root);
+    // lengths are 16-bit, so anything bigger can't be represented
+    if (ret.size() > 0xFFFF)
+        return QByteArray();
+    return ret;
+}
+
+bool QExeRsrcVersionInfo::readNode(int offset, int end, Node *node) const
+{
+    const char *base = m_data.constData();
+    if (offset < 0 || offset + 6 > end)
+        return false;
+    const int length = qFromLittleEndian<quint16>(base + offset);
+    const int valueLength = qFromLittleEndian<quint16>(base + offset + 2);
+    if (length < 6 || offset + length > end)
+        return false;
+    node->offset = offset;
+    node->end = offset + length;
+    node->type = qFromLittleEndian<quint16>(base + offset + 4);
+    node->keyOffset = offset + 6;
+    int pos = node->keyOffset;
+    while (pos + 2 <= node->end && qFromLittleEndian<quint16>(base + pos) != 0)
+        pos += 2;
+    if (pos + 2 > node->end)
+        return false;
+    node->keyLength = (pos - node->keyOffset) / 2;
+    node->valueOffset = qMin(alignDWord(pos + 2), node->end);
+    // text values have their length in characters, binary values in bytes
+    node->valueSize = qMin(node->type == 1 ? valueLength * 2 : valueLength, node->end - node->valueOffset);
+    node->childOffset = qMin(alignDWord(node->valueOffset + node->valueSize), node->end);
+    return true;
+}
+
+QVector<QExeRsrcVersionInfo::Node> QExeRsrcVersionInfo::children(const Node &node) const
+{
+    QVector<Node> ret;
+    Node child;
+    for (int offset = node.childOffset; readNode(offset, node.end, &child); offset = alignDWord(child.end))
+        ret += child;
+    return ret;
+}
+
+bool QExeRsrcVersionInfo::findChild(const Node &node, const QString &key, Node *child) const
+{
+    for (int offset = node.childOffset; readNode(offset, node.end, child); offset = alignDWord(child->end)) {
+        if (keyEquals(*child, key))
+            return true;
+    }
+    return false;
+}
+
+bool QExeRsrcVersionInfo::keyEquals(const Node &node, const QString &key) const
+{
+    if (node.keyLength != key.size())
+        return false;
+    const char *src = m_data.constData() + node.keyOffset;
+    for (int i = 0; i < node.keyLength; i++) {
+        if (qFromLittleEndian<quint16>(src + i * 2) != key.at(i).unicode())
+            return false;
+    }
+    return true;
+}
+
+QString QExeRsrcVersionInfo::key(const Node &node) const
+{
+    return QExeUtf16::fromLE(m_data.constData() + node.keyOffset, node.keyLength);
+}
+
+QString QExeRsrcVersionInfo::text(const Node &node) const
+{
+    // drop the terminator (and any padding NULs some tools leave behind)
+    int len = node.valueSize / 2;
+    const char *src = m_data.constData() + node.valueOffset;
+    while (len > 0 && qFromLittleEndian<quint16>(src + (len - 1) * 2) == 0)
+        len--;
+    return QExeUtf16::fromLE(src, len);
+}
@@ -0,0 +1,73 @@
+#ifndef QEXERSRCVERSIONINFO_H
+#define QEXERSRCVERSIONINFO_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+
+// view over a VS_VERSIONINFO block (the data of a QExeRsrcEntry::VersionInfo entry)
+// the view shares the block's bytes, nodes are only walked and decoded when asked for
+class QEXE_EXPORT QExeRsrcVersionInfo
+{
+public:
+    // VS_FIXEDFILEINFO, minus the signature
+    struct FixedFileInfo {
+        quint32 structVersion;
+        quint32 fileVersionMS;
+        quint32 fileVersionLS;
+        quint32 productVersionMS;
+        quint32 productVersionLS;
+        quint32 fileFlagsMask;
+        quint32 fileFlags;
+        quint32 fileOS;
+        quint32 fileType;
+        quint32 fileSubtype;
+        quint32 fileDateMS;
+        quint32 fileDateLS;
+    };
+    // a StringFileInfo child, key is the language and codepage in hex (e.g. "040904B0")
+    struct StringTable {
+        QString key;
+        QVector<QPair<QString, QString>> strings;
+    };
+
+    QExeRsrcVersionInfo();
+    explicit QExeRsrcVersionInfo(const QByteArray &data);
+    bool isValid() const;
+    bool hasFixedFileInfo() const;
+    FixedFileInfo fixedFileInfo() const;
+    QStringList stringTableKeys() const;
+    // looks key up in the given string table, or in the first one if tableKey is empty
+    QString stringValue(const QString &key, const QString &tableKey = QString()) const;
+    QVector<StringTable> stringTables() const;
+    // each translation is a language ID in the low word and a codepage in the high word
+    QVector<quint32> translations() const;
+
+    static QByteArray encode(const FixedFileInfo &fixed, const QVector<StringTable> &tables, const QVector<quint32> &translations);
+private:
+    struct Node {
+        int offset;
+        int end;
+        quint16 type;
+        int keyOffset;
+        int keyLength;
+        int valueOffset;
+        int valueSize; // in bytes
+        int childOffset;
+    };
+    bool readNode(int offset, int end, Node *node) const;
+    QVector<Node> children(const Node &node) const;
+    bool findChild(const Node &node, const QString &key, Node *child) const;
+    bool keyEquals(const Node &node, const QString &key) const;
+    QString key(const Node &node) const;
+    QString text(const Node &node) const;
+
+    QByteArray m_data;
+    Node m_root;
+    bool m_valid;
+};
+
+#endif // QEXERSRCVERSIONINFO_H
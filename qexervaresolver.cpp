@@ -0,0 +1,75 @@
+#include "qexervaresolver.h"
+
+#include <algorithm>
+
+#include "qexesectionmanager.h"
+
+QExeRVAResolver::QExeRVAResolver()
+{
+}
+
+QExeRVAResolver::QExeRVAResolver(const QExeSectionManager &secMgr)
+{
+    m_spans.reserve(secMgr.sectionCount());
+    for (int i = 0; i < secMgr.sectionCount(); i++) {
+        QExeSectionPtr section = secMgr.sectionAt(i);
+        Span span;
+        span.rva = section->virtualAddr;
+        // anything past the virtual size isn't mapped
+        span.size = qMin<quint32>(section->virtualSize, static_cast<quint32>(section->rawData.size()));
+        if (span.size == 0)
+            continue;
+        span.data = section->rawData;
+        m_spans += span;
+    }
+    std::sort(m_spans.begin(), m_spans.end(), [](const Span &span1, const Span &span2) {
+        return span1.rva < span2.rva;
+    });
+}
+
+bool QExeRVAResolver::isEmpty() const
+{
+    return m_spans.isEmpty();
+}
+
+const char *QExeRVAResolver::pointer(quint32 rva, quint32 size) const
+{
+    const Span *span = spanAt(rva);
+    if (span == nullptr || static_cast<quint64>(rva - span->rva) + size > span->size)
+        return nullptr;
+    return span->data.constData() + (rva - span->rva);
+}
+
+quint32 QExeRVAResolver::available(quint32 rva) const
+{
+    const Span *span = spanAt(rva);
+    if (span == nullptr)
+        return 0;
+    return span->size - (rva - span->rva);
+}
+
+QLatin1String QExeRVAResolver::string(quint32 rva, int maxLength) const
+{
+    const char *src = pointer(rva);
+    if (src == nullptr)
+        return QLatin1String();
+    const int len = static_cast<int>(qMin<quint32>(available(rva), static_cast<quint32>(maxLength)));
+    const char *end = static_cast<const char *>(memchr(src, 0, static_cast<size_t>(len)));
+    if (end == nullptr)
+        return QLatin1String();
+    return QLatin1String(src, static_cast<int>(end - src));
+}
+
+const QExeRVAResolver::Span *QExeRVAResolver::spanAt(quint32 rva) const
+{
+    // find the last span starting at or before rva
+    auto it = std::upper_bound(m_spans.constBegin(), m_spans.constEnd(), rva, [](quint32 rva, const Span &span) {
+        return rva < span.rva;
+    });
+    if (it == m_spans.constBegin())
+        return nullptr;
+    --it;
+    if (rva - it->rva >= it->size)
+        return nullptr;
+    return &*it;
+}
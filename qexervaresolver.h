@@ -0,0 +1,46 @@
+#ifndef QEXERVARESOLVER_H
+#define QEXERVARESOLVER_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QVector>
+#include <QtEndian>
+
+class QExeSectionManager;
+
+// read-only snapshot of an image's sections, for turning RVAs into pointers without copying anything
+// section data is shared with the sections (QByteArray is implicitly shared), so pointers stay valid
+// for as long as the resolver does, even if the sections are changed afterwards
+class QEXE_EXPORT QExeRVAResolver
+{
+public:
+    QExeRVAResolver();
+    explicit QExeRVAResolver(const QExeSectionManager &secMgr);
+    bool isEmpty() const;
+    // returns nullptr unless [rva, rva + size) is inside a single section's raw data
+    const char *pointer(quint32 rva, quint32 size = 1) const;
+    // number of bytes that can be read starting at rva
+    quint32 available(quint32 rva) const;
+    template<typename T>
+    bool read(quint32 rva, T *value) const {
+        const char *src = pointer(rva, sizeof(T));
+        if (src == nullptr)
+            return false;
+        *value = qFromLittleEndian<T>(src);
+        return true;
+    }
+    // NUL-terminated string at rva, or a null QLatin1String if it isn't terminated within maxLength bytes
+    QLatin1String string(quint32 rva, int maxLength = 0x10000) const;
+private:
+    struct Span {
+        quint32 rva;
+        quint32 size; // mapped part of data
+        QByteArray data;
+    };
+    QVector<Span> m_spans; // sorted by RVA
+    const Span *spanAt(quint32 rva) const;
+};
+
+#endif // QEXERVARESOLVER_H
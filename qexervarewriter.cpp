@@ -0,0 +1,546 @@
+#include "qexervarewriter_p.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+
+#include "qexe.h"
+#include "qexeexceptiontable.h"
+#include "qexeexporttable.h"
+#include "qexeimporttable.h"
+#include "qexereloctable.h"
+
+static const quint32 delayDescriptorSize = 32;
+static const quint32 debugDirectorySize = 28;
+
+// IMAGE_LOAD_CONFIG_DIRECTORY fields, as (32-bit offset, 64-bit offset)
+struct LoadConfigField {
+    quint32 offset32;
+    quint32 offset64;
+};
+static const LoadConfigField loadConfigGuardFlags = { 88, 144 };
+// tables of RVAs, each field is followed by the table's entry count
+static const LoadConfigField loadConfigSEHandlerTable = { 64, 96 };
+static const LoadConfigField loadConfigGuardTables[] = {
+    { 80, 128 }, // GuardCFFunctionTable
+    { 104, 160 }, // GuardAddressTakenIatEntryTable
+    { 112, 176 }, // GuardLongJumpTargetTable
+    { 164, 264 } // GuardEHContinuationTable
+};
+// structures in formats of their own, which (like handler data) point into code
+static const LoadConfigField loadConfigOpaque[] = {
+    { 120, 192 }, // DynamicValueRelocTable
+    { 124, 200 }, // CHPEMetadataPointer
+    { 160, 256 } // VolatileMetadataPointer
+};
+static const LoadConfigField loadConfigDynamicRelocOffset = { 136, 224 };
+// the guard tables' entries have this many bytes of flags after the RVA
+static const quint32 guardFlagsStrideShift = 28;
+
+// UNWIND_INFO flags (x64)
+static const quint8 unwindExceptionHandler = 0x1;
+static const quint8 unwindTerminationHandler = 0x2;
+static const quint8 unwindChainInfo = 0x4;
+
+QExeRVARewriter::QExeRVARewriter(QExe &exeDat, quint32 from, quint32 to) : m_exeDat(exeDat)
+{
+    m_from = from;
+    m_to = to;
+}
+
+bool QExeRVARewriter::collect(QExeErrorInfo *errinfo)
+{
+    QSharedPointer<QExeSectionManager> secMgr = m_exeDat.sectionManager();
+    m_resolver = QExeRVAResolver(*secMgr);
+    m_sections.clear();
+    for (int i = 0; i < secMgr->sectionCount(); i++)
+        m_sections += secMgr->sectionAt(i);
+    std::sort(m_sections.begin(), m_sections.end(), [](const QExeSectionPtr &sec1, const QExeSectionPtr &sec2) {
+        return sec1->virtualAddr < sec2->virtualAddr;
+    });
+    m_slots.clear();
+    m_unwindInfos.clear();
+    m_opaqueRefs = false;
+    if (!collectImports(errinfo) || !collectDelayImports(errinfo) || !collectExports(errinfo) || !collectRelocs(errinfo)
+            || !collectExceptions(errinfo) || !collectResources(errinfo) || !collectDebugData(errinfo) || !collectLoadConfig(errinfo)
+            || !checkOpaqueRefs(errinfo))
+        return false;
+    // structures may share fields (e.g. unwind info used by several functions), but each one can only be patched once
+    std::sort(m_slots.begin(), m_slots.end(), [](const Slot &slot1, const Slot &slot2) {
+        return slot1.section != slot2.section ? slot1.section < slot2.section : slot1.offset < slot2.offset;
+    });
+    m_slots.erase(std::unique(m_slots.begin(), m_slots.end(), [](const Slot &slot1, const Slot &slot2) {
+        return slot1.section == slot2.section && slot1.offset == slot2.offset;
+    }), m_slots.end());
+    return true;
+}
+
+void QExeRVARewriter::apply(qint64 shift)
+{
+    QSharedPointer<QExeOptionalHeader> optHead = m_exeDat.optionalHeader();
+    const quint32 shift32 = static_cast<quint32>(shift);
+    // header fields
+    if (moves(optHead->entryPointAddr))
+        optHead->entryPointAddr += shift32;
+    if (moves(optHead->codeBaseAddr))
+        optHead->codeBaseAddr += shift32;
+    if (!optHead->isPlus && moves(optHead->dataBaseAddr))
+        optHead->dataBaseAddr += shift32;
+    for (int i = 0; i < optHead->dataDirectories.size(); i++) {
+        // the certificate table is addressed by file offset
+        if (i == QExeOptionalHeader::CertificateTable)
+            continue;
+        DataDirectoryPtr dir = optHead->dataDirectories[i];
+        if (dir->second != 0 && moves(dir->first))
+            dir->first += shift32;
+    }
+    // section data, slots are sorted by section so each one is detached once
+    QExeSection *section = nullptr;
+    char *data = nullptr;
+    foreach (const Slot &slot, m_slots) {
+        if (slot.section != section) {
+            section = slot.section;
+            data = section->rawData.data();
+        }
+        char *dst = data + slot.offset;
+        if (slot.width == 8)
+            qToLittleEndian<quint64>(qFromLittleEndian<quint64>(dst) + static_cast<quint64>(shift), dst);
+        else
+            qToLittleEndian<quint32>(qFromLittleEndian<quint32>(dst) + shift32, dst);
+    }
+}
+
+bool QExeRVARewriter::moves(quint32 rva) const
+{
+    return rva >= m_from && rva <= m_to;
+}
+
+bool QExeRVARewriter::locate(quint32 rva, quint8 width, Slot *slot, QExeErrorInfo *errinfo) const
+{
+    auto it = std::upper_bound(m_sections.constBegin(), m_sections.constEnd(), rva, [](quint32 rva, const QExeSectionPtr &sec) {
+        return rva < sec->virtualAddr;
+    });
+    if (it != m_sections.constBegin()) {
+        --it;
+        const quint64 offset = rva - (*it)->virtualAddr;
+        if (offset + width <= static_cast<quint64>((*it)->rawData.size())) {
+            slot->section = it->data();
+            slot->offset = static_cast<quint32>(offset);
+            slot->width = width;
+            return true;
+        }
+    }
+    if (errinfo != nullptr) {
+        errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+        errinfo->details += rva;
+    }
+    return false;
+}
+
+bool QExeRVARewriter::addRVA(quint32 rva, QExeErrorInfo *errinfo, bool force)
+{
+    Slot slot;
+    if (!locate(rva, 4, &slot, errinfo))
+        return false;
+    if (force || moves(qFromLittleEndian<quint32>(slot.section->rawData.constData() + slot.offset)))
+        m_slots += slot;
+    return true;
+}
+
+bool QExeRVARewriter::addVA(quint32 rva, bool is64, QExeErrorInfo *errinfo)
+{
+    Slot slot;
+    if (!locate(rva, is64 ? 8 : 4, &slot, errinfo))
+        return false;
+    const char *src = slot.section->rawData.constData() + slot.offset;
+    const quint64 va = is64 ? qFromLittleEndian<quint64>(src) : qFromLittleEndian<quint32>(src);
+    const quint64 imageBase = m_exeDat.optionalHeader()->imageBase;
+    if (va >= imageBase && va - imageBase <= 0xFFFFFFFFu && moves(static_cast<quint32>(va - imageBase)))
+        m_slots += slot;
+    return true;
+}
+
+// hint/name RVAs in an import lookup table
+bool QExeRVARewriter::addThunks(quint32 rva, bool isPlus, QExeErrorInfo *errinfo)
+{
+    const quint32 thunkSize = isPlus ? 8 : 4;
+    const quint64 ordinalFlag = isPlus ? Q_UINT64_C(0x8000000000000000) : 0x80000000u;
+    for (;; rva += thunkSize) {
+        quint64 thunk;
+        quint32 thunk32;
+        if (isPlus ? !m_resolver.read(rva, &thunk) : !m_resolver.read(rva, &thunk32)) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+                errinfo->details += rva;
+            }
+            return false;
+        }
+        if (!isPlus)
+            thunk = thunk32;
+        if (thunk == 0)
+            break;
+        // the RVA is in the low 31 bits, so only those need patching
+        if ((thunk & ordinalFlag) == 0 && !addRVA(rva, errinfo))
+            return false;
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectImports(QExeErrorInfo *errinfo)
+{
+    quint32 rva;
+    if (!dataDirectory(QExeOptionalHeader::ImportTable, &rva))
+        return true;
+    const bool isPlus = m_exeDat.optionalHeader()->isPlus;
+    QExeImportTable imports;
+    if (!imports.read(m_resolver, rva, isPlus, errinfo))
+        return false;
+    for (int i = 0; i < imports.moduleCount(); i++, rva += 20) {
+        const QExeImportTable::Module &module = imports.moduleAt(i);
+        if (!addRVA(rva, errinfo) || !addRVA(rva + 12, errinfo) || !addRVA(rva + 16, errinfo))
+            return false;
+        if (module.lookupRVA != 0 && !addThunks(module.lookupRVA, isPlus, errinfo))
+            return false;
+        // bound address tables hold the imported addresses instead of hint/name RVAs
+        if ((module.lookupRVA == 0 || module.timestamp == 0) && !addThunks(module.addressRVA, isPlus, errinfo))
+            return false;
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectDelayImports(QExeErrorInfo *errinfo)
+{
+    quint32 rva;
+    if (!dataDirectory(QExeOptionalHeader::DelayImportDescriptor, &rva))
+        return true;
+    for (;; rva += delayDescriptorSize) {
+        const char *desc = m_resolver.pointer(rva, delayDescriptorSize);
+        if (desc == nullptr) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+                errinfo->details += rva;
+            }
+            return false;
+        }
+        const quint32 attributes = qFromLittleEndian<quint32>(desc);
+        const quint32 nameRVA = qFromLittleEndian<quint32>(desc + 4);
+        if (nameRVA == 0)
+            break;
+        // old-style descriptors hold absolute addresses, which the base relocations already cover
+        if ((attributes & 1) == 0)
+            continue;
+        // DLL name, module handle, IAT, name table, bound IAT, unload IAT
+        for (quint32 field = 4; field < 28; field += 4) {
+            if (!addRVA(rva + field, errinfo))
+                return false;
+        }
+        const quint32 nameTableRVA = qFromLittleEndian<quint32>(desc + 16);
+        if (nameTableRVA != 0 && !addThunks(nameTableRVA, m_exeDat.optionalHeader()->isPlus, errinfo))
+            return false;
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectExports(QExeErrorInfo *errinfo)
+{
+    quint32 rva, size;
+    if (!dataDirectory(QExeOptionalHeader::ExportTable, &rva, &size))
+        return true;
+    QExeExportTable exports;
+    if (!exports.read(m_resolver, rva, size, errinfo))
+        return false;
+    // name, address table, name pointer table, ordinal table
+    if (!addRVA(rva + 12, errinfo) || !addRVA(rva + 28, errinfo) || !addRVA(rva + 32, errinfo) || !addRVA(rva + 36, errinfo))
+        return false;
+    quint32 functionsRVA = 0, namesRVA = 0;
+    m_resolver.read(rva + 28, &functionsRVA);
+    m_resolver.read(rva + 32, &namesRVA);
+    for (quint32 i = 0; i < exports.functionCount(); i++) {
+        if (!addRVA(functionsRVA + i * 4, errinfo))
+            return false;
+    }
+    for (quint32 i = 0; i < exports.nameCount(); i++) {
+        if (!addRVA(namesRVA + i * 4, errinfo))
+            return false;
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectRelocs(QExeErrorInfo *errinfo)
+{
+    quint32 rva, size;
+    QExeRelocTable relocs;
+    if (dataDirectory(QExeOptionalHeader::BaseRelocationTable, &rva, &size) && !relocs.read(m_resolver, rva, size, errinfo))
+        return false;
+    // without relocations, absolute addresses can't be told apart from other data, so only sections nothing
+    // addresses that way may move
+    if (relocs.blockCount() == 0) {
+        quint32 sectionRVA;
+        if (movesOnlyRsrcAndRelocs(&sectionRVA))
+            return true;
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadSection_UnsupportedFixup;
+            errinfo->details += sectionRVA;
+        }
+        return false;
+    }
+    const char *first = relocs.blockAt(0).entries;
+    for (int i = 0; i < relocs.blockCount(); i++) {
+        const QExeRelocTable::Block &block = relocs.blockAt(i);
+        // the block's page RVA, relative to the first block's header
+        if (!addRVA(rva + static_cast<quint32>(block.entries - first), errinfo))
+            return false;
+        for (int j = 0; j < block.count; j++) {
+            quint16 entry = QExeRelocTable::entryAt(block, j);
+            const quint32 target = block.pageRVA + QExeRelocTable::entryOffset(entry);
+            switch (QExeRelocTable::entryType(entry)) {
+            case QExeRelocTable::Absolute:
+                break;
+            case QExeRelocTable::HighLow:
+                if (!addVA(target, false, errinfo))
+                    return false;
+                break;
+            case QExeRelocTable::Dir64:
+                if (!addVA(target, true, errinfo))
+                    return false;
+                break;
+            default:
+                // split 16-bit fixups don't hold enough of the address to tell where it points
+                if (errinfo != nullptr) {
+                    errinfo->errorID = QExeErrorInfo::BadSection_UnsupportedFixup;
+                    errinfo->details += target;
+                }
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectExceptions(QExeErrorInfo *errinfo)
+{
+    quint32 rva, size;
+    if (!dataDirectory(QExeOptionalHeader::ExceptionTable, &rva, &size))
+        return true;
+    switch (m_exeDat.coffHeader()->machineType) {
+    case QExeCOFFHeader::AMD64: {
+        QExeExceptionTable functions;
+        if (!functions.read(m_resolver, rva, size, errinfo))
+            return false;
+        for (int i = 0; i < functions.functionCount(); i++, rva += 12) {
+            QExeExceptionTable::Function function = functions.functionAt(i);
+            // a function may end right where the moved range starts, so its end moves with its start
+            if (!addRVA(rva, errinfo) || (moves(function.beginRVA) && !addRVA(rva + 4, errinfo, true)) || !addRVA(rva + 8, errinfo)
+                    || !collectUnwindInfo(function.unwindInfoRVA, 0, errinfo))
+                return false;
+        }
+        return true;
+    }
+    case QExeCOFFHeader::ARM:
+    case QExeCOFFHeader::ARMNT:
+    case QExeCOFFHeader::ARM64:
+        // .xdata records aren't parsed, so their handler RVAs and handler data are treated like x64 handler data
+        m_opaqueRefs = true;
+        // 8-byte entries: start RVA, then either packed unwind data or the RVA of an .xdata record
+        for (quint32 pos = 0; pos + 8 <= size; pos += 8) {
+            quint32 unwindData;
+            if (!addRVA(rva + pos, errinfo))
+                return false;
+            m_resolver.read(rva + pos + 4, &unwindData);
+            if ((unwindData & 3) == 0 && !addRVA(rva + pos + 4, errinfo))
+                return false;
+        }
+        return true;
+    default:
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+}
+
+bool QExeRVARewriter::collectUnwindInfo(quint32 rva, int depth, QExeErrorInfo *errinfo)
+{
+    if (m_unwindInfos.contains(rva))
+        return true;
+    m_unwindInfos.insert(rva);
+    const char *info = m_resolver.pointer(rva, 4);
+    // guard against looping chains
+    if (info == nullptr || depth > 32) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    const quint8 flags = static_cast<quint8>(info[0]) >> 3;
+    const quint32 codeCount = static_cast<quint8>(info[2]);
+    // unwind codes are 2 bytes each, padded to an even count
+    const quint32 tail = rva + 4 + ((codeCount + 1) & ~1u) * 2;
+    if ((flags & unwindChainInfo) != 0) {
+        // chained RUNTIME_FUNCTION
+        quint32 beginRVA = 0, unwindRVA = 0;
+        m_resolver.read(tail, &beginRVA);
+        m_resolver.read(tail + 8, &unwindRVA);
+        if (!addRVA(tail, errinfo) || (moves(beginRVA) && !addRVA(tail + 4, errinfo, true)) || !addRVA(tail + 8, errinfo))
+            return false;
+        return collectUnwindInfo(unwindRVA, depth + 1, errinfo);
+    }
+    // the handler's own data follows, but its format is up to the handler
+    if ((flags & (unwindExceptionHandler | unwindTerminationHandler)) != 0) {
+        m_opaqueRefs = true;
+        return addRVA(tail, errinfo);
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectResources(QExeErrorInfo *errinfo)
+{
+    quint32 rva;
+    if (!dataDirectory(QExeOptionalHeader::ResourceTable, &rva))
+        return true;
+    const char *data = m_resolver.pointer(rva);
+    if (data == nullptr) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    foreach (quint32 offset, QExeRsrcManager::dataEntryOffsets(data, m_resolver.available(rva), 0)) {
+        if (!addRVA(rva + offset, errinfo))
+            return false;
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectDebugData(QExeErrorInfo *errinfo)
+{
+    quint32 rva, size;
+    if (!dataDirectory(QExeOptionalHeader::DebugData, &rva, &size))
+        return true;
+    // AddressOfRawData, PointerToRawData is a file offset
+    for (quint32 pos = 0; pos + debugDirectorySize <= size; pos += debugDirectorySize) {
+        if (!addRVA(rva + pos + 20, errinfo))
+            return false;
+    }
+    return true;
+}
+
+bool QExeRVARewriter::collectLoadConfig(QExeErrorInfo *errinfo)
+{
+    quint32 rva;
+    if (!dataDirectory(QExeOptionalHeader::LoadConfigTable, &rva))
+        return true;
+    quint32 size;
+    if (!m_resolver.read(rva, &size)) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadDataDir_Unmapped;
+            errinfo->details += rva;
+        }
+        return false;
+    }
+    QSharedPointer<QExeOptionalHeader> optHead = m_exeDat.optionalHeader();
+    const bool isPlus = optHead->isPlus;
+    const quint32 width = isPlus ? 8 : 4;
+    // older versions of the structure end early, missing fields count as 0
+    auto field = [this, rva, size, isPlus](const LoadConfigField &which, quint32 fieldWidth) -> quint64 {
+        const quint32 offset = isPlus ? which.offset64 : which.offset32;
+        if (offset + fieldWidth > size)
+            return 0;
+        quint64 value = 0;
+        quint32 value32 = 0;
+        if (fieldWidth == 8)
+            m_resolver.read(rva + offset, &value);
+        else if (m_resolver.read(rva + offset, &value32))
+            value = value32;
+        return value;
+    };
+    // tables are addressed by VA (covered by the base relocations), their entries are RVAs
+    auto addTable = [this, &field, &optHead, width, errinfo](const LoadConfigField &table, quint32 stride) -> bool {
+        const quint64 va = field(table, width);
+        LoadConfigField countField = { table.offset32 + 4, table.offset64 + 8 };
+        const quint64 count = field(countField, width);
+        if (va == 0 || count == 0)
+            return true;
+        if (va < optHead->imageBase || va - optHead->imageBase > 0xFFFFFFFFu || count > 0xFFFFFFFFu / stride) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadDataDir_InvalidFormat;
+                errinfo->details += static_cast<quint64>(va);
+            }
+            return false;
+        }
+        const quint32 tableRVA = static_cast<quint32>(va - optHead->imageBase);
+        for (quint32 i = 0; i < count; i++) {
+            if (!addRVA(tableRVA + i * stride, errinfo))
+                return false;
+        }
+        return true;
+    };
+    if (!addTable(loadConfigSEHandlerTable, 4))
+        return false;
+    const quint32 stride = 4 + static_cast<quint32>(field(loadConfigGuardFlags, 4) >> guardFlagsStrideShift);
+    for (const LoadConfigField &table : loadConfigGuardTables) {
+        if (!addTable(table, stride))
+            return false;
+    }
+    for (const LoadConfigField &opaque : loadConfigOpaque) {
+        if (field(opaque, width) != 0)
+            m_opaqueRefs = true;
+    }
+    if (field(loadConfigDynamicRelocOffset, 4) != 0)
+        m_opaqueRefs = true;
+    return true;
+}
+
+bool QExeRVARewriter::checkOpaqueRefs(QExeErrorInfo *errinfo)
+{
+    if (!m_opaqueRefs)
+        return true;
+    // the RVAs in these point into code, into read-only tables (e.g. C++ FuncInfo) and into writable data (e.g. C++
+    // type descriptors), so only sections that are known to hold nothing of the sort may move
+    quint32 sectionRVA;
+    if (movesOnlyRsrcAndRelocs(&sectionRVA))
+        return true;
+    if (errinfo != nullptr) {
+        errinfo->errorID = QExeErrorInfo::BadSection_UnsupportedFixup;
+        errinfo->details += sectionRVA;
+    }
+    return false;
+}
+
+bool QExeRVARewriter::movesOnlyRsrcAndRelocs(quint32 *sectionRVA) const
+{
+    quint32 rsrcRVA = 0, relocRVA = 0;
+    dataDirectory(QExeOptionalHeader::ResourceTable, &rsrcRVA);
+    dataDirectory(QExeOptionalHeader::BaseRelocationTable, &relocRVA);
+    foreach (QExeSectionPtr section, m_sections) {
+        if (!moves(section->virtualAddr))
+            continue;
+        auto contains = [&section](quint32 rva) {
+            return rva != 0 && rva >= section->virtualAddr && rva - section->virtualAddr < static_cast<quint32>(section->rawData.size());
+        };
+        // some linkers leave .rsrc writable, so only code rules a section out on its own
+        if ((section->characteristics & (QExeSection::ContainsCode | QExeSection::IsExecutable)) != 0
+                || (!contains(rsrcRVA) && !contains(relocRVA))) {
+            *sectionRVA = section->virtualAddr;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QExeRVARewriter::dataDirectory(int dir, quint32 *rva, quint32 *size) const
+{
+    QSharedPointer<QExeOptionalHeader> optHead = m_exeDat.optionalHeader();
+    if (optHead->dataDirectories.size() <= dir)
+        return false;
+    DataDirectoryPtr dataDir = optHead->dataDirectories[dir];
+    if (dataDir->first == 0 || dataDir->second == 0)
+        return false;
+    *rva = dataDir->first;
+    if (size != nullptr)
+        *size = dataDir->second;
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef QEXERVAREWRITER_P_H
+#define QEXERVAREWRITER_P_H
+
+#include <QSet>
+#include <QVector>
+
+#include "qexeerrorinfo.h"
+#include "qexesection.h"
+#include "qexervaresolver.h"
+
+class QExe;
+
+// finds every field of an image that holds an address into [from, to], so that part of the image can be moved
+// without relinking: header fields, data directories, imports, delay imports, exports, base relocations
+// (both the blocks and the addresses they fix up), exception data, resources, debug directories and the load config
+// directory's SafeSEH and guard tables
+// code that addresses the moved range relative to itself (e.g. x64 RIP-relative operands) can't be found this way,
+// and neither can the RVAs in exception handler data (__C_specific_handler scope tables, C++ FuncInfo), ARM .xdata
+// records or the load config directory's dynamic relocations, CHPE and volatile metadata; if an image has any of
+// those, only the sections holding the resources or the base relocations may move
+class QExeRVARewriter
+{
+public:
+    QExeRVARewriter(QExe &exeDat, quint32 from, quint32 to);
+    // fails without changing anything if one of the structures can't be parsed, if the image has no base
+    // relocations (absolute addresses can't be found without them) or if opaque structures may point into the range,
+    // unless the range only holds the resources and/or the base relocations, which are only addressed by RVA
+    bool collect(QExeErrorInfo *errinfo = nullptr);
+    // adds shift to every collected field
+    // the sections themselves must have been moved already, fields are patched through their sections
+    void apply(qint64 shift);
+private:
+    struct Slot {
+        QExeSection *section;
+        quint32 offset;
+        quint8 width; // 4 or 8 bytes
+    };
+
+    bool moves(quint32 rva) const;
+    bool locate(quint32 rva, quint8 width, Slot *slot, QExeErrorInfo *errinfo) const;
+    // the field at rva is an RVA, collected if it points into the moved range (or always, if force is set)
+    bool addRVA(quint32 rva, QExeErrorInfo *errinfo, bool force = false);
+    // the field at rva is an absolute address
+    bool addVA(quint32 rva, bool is64, QExeErrorInfo *errinfo);
+    bool addThunks(quint32 rva, bool isPlus, QExeErrorInfo *errinfo);
+    bool collectImports(QExeErrorInfo *errinfo);
+    bool collectDelayImports(QExeErrorInfo *errinfo);
+    bool collectExports(QExeErrorInfo *errinfo);
+    bool collectRelocs(QExeErrorInfo *errinfo);
+    bool collectExceptions(QExeErrorInfo *errinfo);
+    bool collectUnwindInfo(quint32 rva, int depth, QExeErrorInfo *errinfo);
+    bool collectResources(QExeErrorInfo *errinfo);
+    bool collectDebugData(QExeErrorInfo *errinfo);
+    bool collectLoadConfig(QExeErrorInfo *errinfo);
+    bool checkOpaqueRefs(QExeErrorInfo *errinfo);
+    // whether every moved section holds just the resources or the base relocations, sectionRVA is set to the first
+    // one that doesn't
+    bool movesOnlyRsrcAndRelocs(quint32 *sectionRVA) const;
+    bool dataDirectory(int dir, quint32 *rva, quint32 *size = nullptr) const;
+
+    QExe &m_exeDat;
+    quint32 m_from;
+    quint32 m_to;
+    QExeRVAResolver m_resolver;
+    QVector<QExeSectionPtr> m_sections; // sorted by RVA
+    QVector<Slot> m_slots;
+    QSet<quint32> m_unwindInfos; // already visited
+    bool m_opaqueRefs; // found structures holding RVAs in formats that aren't parsed
+};
+
+#endif // QEXERVAREWRITER_P_H
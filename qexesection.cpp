@@ -7,6 +7,7 @@ QExeSection::QExeSection(QObject *parent) : QObject(parent)
     virtualSize = 0;
     rawData.resize(0);
     rawDataPtr = 0;
+    filePos = 0;
     characteristics = Characteristics();
     linearize = false;
 }
@@ -19,6 +20,7 @@ QExeSection::QExeSection(const QLatin1String &name, QByteArray data, QExeSection
     virtualSize = rawData.size();
     rawData = data;
     rawDataPtr = 0;
+    filePos = 0;
     characteristics = chars;
     linearize = false;
 }
@@ -31,10 +33,16 @@ QExeSection::QExeSection(const QLatin1String &name, quint32 size, QExeSection::C
     virtualSize = size;
     rawData.resize(static_cast<int>(size));
     rawDataPtr = 0;
+    filePos = 0;
     characteristics = chars;
     linearize = false;
 }
 
+quint32 QExeSection::rawDataPointer() const
+{
+    return rawDataPtr;
+}
+
 QLatin1String QExeSection::name() const
 {
     return QLatin1String(nameBytes);
@@ -45,3 +53,14 @@ void QExeSection::setName(const QLatin1String &name)
     nameBytes = QByteArray(name.data());
     nameBytes.resize(8);
 }
+
+bool QExeSection::isFileBacked()
+{
+    if (fileData.isEmpty())
+        return false;
+    if (rawData.constData() == fileData.constData() && rawData.size() == fileData.size())
+        return true;
+    // changed since it was read, the old buffer isn't needed anymore
+    fileData = QByteArray();
+    return false;
+}
@@ -69,11 +69,20 @@ public:
     quint16 relocsCount;
     quint16 linenumsCount;
     Characteristics characteristics;
+    // file offset of rawData, as read or as laid out by the last write
+    quint32 rawDataPointer() const;
 private:
+    friend class QExe;
     friend class QExeSectionManager;
 
     QByteArray nameBytes;
     quint32 rawDataPtr;
+    // where rawData was read from in the source file, and the buffer it was read into
+    // any change to rawData detaches it from that buffer, so comparing the two tells changed sections apart without
+    // looking at their data; the buffer is let go of once that happens
+    quint32 filePos;
+    QByteArray fileData;
+    bool isFileBacked();
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(QExeSection::Characteristics)
@@ -5,6 +5,7 @@
 #include <QDataStream>
 
 #include "qexe.h"
+#include "qexervarewriter_p.h"
 
 #define SET_ERROR_INFO(errName) \
     if (errinfo != nullptr) { \
@@ -56,6 +57,29 @@ QVector<bool> QExeSectionManager::containsSections(QVector<QExeSectionPtr> secs)
     return ret;
 }
 
+bool QExeSectionManager::canAddSectionHeader(QExeErrorInfo *errinfo) const
+{
+    return canAddSectionHeader(0xFFFFFFFFu, errinfo);
+}
+
+bool QExeSectionManager::canAddSectionHeader(quint32 limit, QExeErrorInfo *errinfo) const
+{
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat->optionalHeader();
+    quint32 newHeaderSize = exeDat->dosStub()->size() + exeDat->coffHeader()->size() + optHead->size() + headerSize() + 0x28;
+    newHeaderSize = QExe::alignForward(newHeaderSize, optHead->fileAlign);
+    // the new section header has to fit in front of the first section
+    foreach (QExeSectionPtr section, sections)
+        limit = qMin(limit, section->virtualAddr);
+    if (newHeaderSize > limit) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadSection_InsufficientHeaderSpace;
+            errinfo->details += newHeaderSize;
+        }
+        return false;
+    }
+    return true;
+}
+
 bool QExeSectionManager::addSection(QExeSectionPtr newSec)
 {
     if (newSec.isNull())
@@ -161,6 +185,148 @@ QExeSectionPtr QExeSectionManager::createSectionInternal(QExeSectionPtr newSec)
     return newSec;
 }
 
+bool QExeSectionManager::insertSectionAt(int index, QExeSectionPtr newSec, QExeErrorInfo *errinfo)
+{
+    // sorts the sections by RVA
+    if (!test(true, nullptr, errinfo))
+        return false;
+    if (index < 0 || index > sections.size()) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadSection_InvalidIndex;
+            errinfo->details += index;
+        }
+        return false;
+    }
+    quint32 rva;
+    if (index < sections.size())
+        rva = sections[index]->virtualAddr;
+    else if (!sections.isEmpty()) {
+        QExeSectionPtr lastSec = sections.last();
+        rva = QExe::alignForward(lastSec->virtualAddr + lastSec->virtualSize, exeDat->optionalHeader()->sectionAlign);
+    } else
+        rva = QExe::alignForward(exeDat->optionalHeader()->headerSize, exeDat->optionalHeader()->sectionAlign);
+    return insertSection(rva, newSec, errinfo);
+}
+
+bool QExeSectionManager::insertSectionBefore(QExeSectionPtr sec, QExeSectionPtr newSec, QExeErrorInfo *errinfo)
+{
+    if (!sections.contains(sec) || !test(true, nullptr, errinfo))
+        return false;
+    return insertSection(sec->virtualAddr, newSec, errinfo);
+}
+
+bool QExeSectionManager::insertSection(quint32 rva, QExeSectionPtr newSec, QExeErrorInfo *errinfo)
+{
+    if (newSec.isNull() || sections.contains(newSec))
+        return false;
+    if (sectionIndexByName(newSec->name()) >= 0) {
+        if (errinfo != nullptr) {
+            errinfo->errorID = QExeErrorInfo::BadSection_DuplicateName;
+            errinfo->details += newSec->name();
+        }
+        return false;
+    }
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat->optionalHeader();
+    if (!canAddSectionHeader(rva, errinfo))
+        return false;
+    quint32 imageEnd = rva;
+    QExeSectionPtr section;
+    foreach (section, sections)
+        imageEnd = qMax(imageEnd, section->virtualAddr + section->virtualSize);
+    if (imageEnd > rva) {
+        // base relocation blocks cover whole pages, so the moved part has to stay page-aligned
+        const quint32 align = qMax<quint32>(optHead->sectionAlign, 0x1000);
+        const quint32 shift = QExe::alignForward(qMax<quint32>(qMax<quint32>(newSec->virtualSize, static_cast<quint32>(newSec->rawData.size())), 1), align);
+        // find everything that has to be fixed up before moving anything, so a failure leaves the image untouched
+        QExeRVARewriter rewriter(*exeDat, rva, imageEnd);
+        if (!rewriter.collect(errinfo))
+            return false;
+        foreach (section, sections) {
+            if (section->virtualAddr >= rva)
+                section->virtualAddr += shift;
+        }
+        rewriter.apply(shift);
+    }
+    newSec->virtualAddr = rva;
+    int index = 0;
+    while (index < sections.size() && sections[index]->virtualAddr < rva)
+        index++;
+    sections.insert(index, newSec);
+    exeDat->updateHeaderSizes();
+    return true;
+}
+
+bool QExeSectionManager::resizeSection(QExeSectionPtr sec, quint32 newSize, QVector<Move> *moves, QVector<Collision> *collisions, QExeErrorInfo *errinfo)
+{
+    if (!sections.contains(sec))
+        return false;
+    if (moves != nullptr)
+        moves->clear();
+    if (collisions != nullptr)
+        collisions->clear();
+    QSharedPointer<QExeOptionalHeader> optHead = exeDat->optionalHeader();
+    QExeSectionPtr section;
+    // check memory first, so nothing changes if it doesn't fit
+    if (newSize > sec->virtualSize) {
+        const quint64 newEnd = static_cast<quint64>(sec->virtualAddr) + QExe::alignForward(newSize, optHead->sectionAlign);
+        QVector<Collision> found;
+        foreach (section, sections) {
+            if (section == sec || section->virtualAddr <= sec->virtualAddr || section->virtualAddr >= newEnd)
+                continue;
+            const quint64 end = static_cast<quint64>(section->virtualAddr)
+                    + QExe::alignForward(qMax(qMax(section->virtualSize, static_cast<quint32>(section->rawData.size())), 1u), optHead->sectionAlign);
+            Collision collision = { section, section->virtualAddr, static_cast<quint32>(qMin(newEnd, end) - section->virtualAddr) };
+            found += collision;
+        }
+        if (!found.isEmpty()) {
+            if (errinfo != nullptr) {
+                errinfo->errorID = QExeErrorInfo::BadSection_VirtualOverlap;
+                errinfo->details += sec->name();
+            }
+            if (collisions != nullptr) {
+                std::sort(found.begin(), found.end(), [](const Collision &collision1, const Collision &collision2) {
+                    return collision1.rva < collision2.rva;
+                });
+                *collisions = found;
+            }
+            return false;
+        }
+    }
+    // sections without a file offset yet are placed by the next write anyway
+    const quint32 oldSize = static_cast<quint32>(sec->rawData.size());
+    if (newSize > oldSize && oldSize != 0 && sec->rawDataPtr != 0) {
+        const quint32 fileAlign = optHead->fileAlign;
+        QVector<QExeSectionPtr> following;
+        foreach (section, sections) {
+            if (section != sec && !section->rawData.isEmpty() && section->rawDataPtr > sec->rawDataPtr)
+                following += section;
+        }
+        std::sort(following.begin(), following.end(), [](const QExeSectionPtr &sec1, const QExeSectionPtr &sec2) {
+            return sec1->rawDataPtr < sec2->rawDataPtr;
+        });
+        // push each following section up just far enough, until a gap absorbs the growth
+        quint32 end = sec->rawDataPtr + QExe::alignForward(newSize, fileAlign);
+        foreach (section, following) {
+            if (section->rawDataPtr >= end)
+                break;
+            Move move = { section, section->rawDataPtr, end };
+            section->rawDataPtr = end;
+            // its file offset doesn't match its RVA anymore
+            section->linearize = false;
+            end += QExe::alignForward(static_cast<quint32>(section->rawData.size()), fileAlign);
+            if (moves != nullptr)
+                *moves += move;
+        }
+    }
+    if (newSize > oldSize)
+        sec->rawData.append(QByteArray(static_cast<int>(newSize - oldSize), '\0'));
+    else
+        sec->rawData.truncate(static_cast<int>(newSize));
+    if (sec->virtualSize < newSize)
+        sec->virtualSize = newSize;
+    return true;
+}
+
 QBuffer *QExeSectionManager::setupRVAPoint(quint32 rva, QIODevice::OpenMode mode) const
 {
     rva %= exeDat->optionalHeader()->imageBase;
@@ -215,6 +381,8 @@ bool QExeSectionManager::read(QIODevice &src, QDataStream &ds, QExeErrorInfo *er
         prev = src.pos();
         src.seek(newSec->rawDataPtr);
         newSec->rawData = src.read(rawDataSize);
+        newSec->filePos = newSec->rawDataPtr;
+        newSec->fileData = newSec->rawData;
         src.seek(prev);
         ds >> newSec->relocsPtr;
         ds >> newSec->linenumsPtr;
@@ -231,8 +399,21 @@ bool QExeSectionManager::read(QIODevice &src, QDataStream &ds, QExeErrorInfo *er
 bool QExeSectionManager::write(QIODevice &dst, QDataStream &ds, QExeErrorInfo *errinfo)
 {
     (void)errinfo;
+    writeHeaders(dst, ds);
+    QExeSectionPtr section;
+    // write section data
+    foreach (section, sections) {
+        if (section->rawData.size() == 0)
+            continue;
+        dst.seek(section->rawDataPtr);
+        dst.write(section->rawData);
+    }
+    return true;
+}
+
+void QExeSectionManager::writeHeaders(QIODevice &dst, QDataStream &ds)
+{
     QExeSectionPtr section;
-    // write section headers
     foreach (section, sections) {
         section->nameBytes.resize(8);
         dst.write(section->nameBytes);
@@ -246,14 +427,6 @@ bool QExeSectionManager::write(QIODevice &dst, QDataStream &ds, QExeErrorInfo *e
         ds << section->linenumsCount;
         ds << static_cast<quint32>(section->characteristics);
     }
-    // write section data
-    foreach (section, sections) {
-        if (section->rawData.size() == 0)
-            continue;
-        dst.seek(section->rawDataPtr);
-        dst.write(section->rawData);
-    }
-    return true;
 }
 
 struct AllocSpan {
@@ -314,14 +487,24 @@ bool QExeSectionManager::test(bool justOrderAndOverlap, quint32 *fileSize, QExeE
     AllocMap map;
     // disallow collision with primary header
     map.push_back(AllocSpan(0, exeDat->optionalHeader()->headerSize));
-    for (int i = 0; i < 2; i++) {
-        foreach (section, sections) {
-            if (section->linearize != (i == 0))
+    // linearized sections go first, then sections keep their current file offsets where they still fit
+    // (so growing one section doesn't shuffle the others), then everything else is fit in wherever there's room
+    QVector<bool> placed(sections.size(), false);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < sections.size(); j++) {
+            section = sections[j];
+            if (placed[j] || section->linearize != (i == 0))
                 continue;
             quint32 rawDataSize = static_cast<quint32>(section->rawData.size());
             if (rawDataSize == 0) {
                 // don't bother with this section
                 section->rawDataPtr = 0;
+                placed[j] = true;
+                continue;
+            }
+            if (i == 1) {
+                if (section->rawDataPtr != 0 && section->rawDataPtr % fileAlign == 0)
+                    placed[j] = checkAlloc(map, AllocSpan(section->rawDataPtr, rawDataSize));
                 continue;
             }
             bool ok = false;
@@ -342,6 +525,7 @@ bool QExeSectionManager::test(bool justOrderAndOverlap, quint32 *fileSize, QExeE
                     span.start += fileAlign;
                 section->rawDataPtr = span.start;
             }
+            placed[j] = true;
         }
     }
     if (!fileSize)
@@ -354,7 +538,7 @@ bool QExeSectionManager::test(bool justOrderAndOverlap, quint32 *fileSize, QExeE
         if (v > *fileSize)
             *fileSize = v;
     }
-    QExe::alignForward(*fileSize, fileAlign);
+    *fileSize = QExe::alignForward(*fileSize, fileAlign);
     return true;
 }
 
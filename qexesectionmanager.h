@@ -19,6 +19,17 @@ class QEXE_EXPORT QExeSectionManager : public QObject
 {
     Q_OBJECT
 public:
+    struct Move {
+        QExeSectionPtr section;
+        quint32 oldFilePos;
+        quint32 newFilePos;
+    };
+    struct Collision {
+        QExeSectionPtr section; // section in the way
+        quint32 rva; // start of the overlap
+        quint32 size;
+    };
+
     quint32 headerSize() const;
     int sectionCount() const;
     QExeSectionPtr sectionAt(int index) const;
@@ -26,6 +37,8 @@ public:
     QExeSectionPtr sectionWithName(const QLatin1String &name) const;
     bool containsSection(QExeSectionPtr sec) const;
     QVector<bool> containsSections(QVector<QExeSectionPtr> secs) const;
+    // whether the header of one more section fits in front of the first section
+    bool canAddSectionHeader(QExeErrorInfo *errinfo = nullptr) const;
     bool addSection(QExeSectionPtr newSec);
     QVector<bool> addSections(QVector<QExeSectionPtr> newSecs);
     bool removeSection(QExeSectionPtr sec);
@@ -36,6 +49,17 @@ public:
     QVector<QExeSectionPtr> removeSections(QVector<QLatin1String> names);
     QExeSectionPtr createSection(const QLatin1String &name, QByteArray data, QExeSection::Characteristics chars = QExeSection::ContainsInitializedData | QExeSection::IsReadable);
     QExeSectionPtr createSection(const QLatin1String &name, quint32 size, QExeSection::Characteristics chars = QExeSection::ContainsUninitializedData | QExeSection::IsReadable | QExeSection::IsWritable);
+    // inserts newSec at index (in RVA order) and moves every later section up to make room,
+    // rewriting every reference to the moved sections that can be found (see QExeRVARewriter for what can't,
+    // which makes this fail instead of moving code or data that's referred to that way)
+    bool insertSectionAt(int index, QExeSectionPtr newSec, QExeErrorInfo *errinfo = nullptr);
+    bool insertSectionBefore(QExeSectionPtr sec, QExeSectionPtr newSec, QExeErrorInfo *errinfo = nullptr);
+    // resizes sec's raw data (growth is zero-filled), growing its virtual size along with it
+    // the section grows in place if its file alignment leaves room, otherwise the sections after it in the file are
+    // moved up as little as needed (listed in moves, file offsets are kept by the next write)
+    // fails without changing anything if the section would run into the next one in memory (listed in collisions)
+    bool resizeSection(QExeSectionPtr sec, quint32 newSize, QVector<Move> *moves = nullptr, QVector<Collision> *collisions = nullptr,
+                       QExeErrorInfo *errinfo = nullptr);
     int rsrcSectionIndex();
     QBuffer *setupRVAPoint(quint32 rva, QIODevice::OpenMode mode) const;
 private:
@@ -46,9 +70,12 @@ private:
     QVector<QExeSectionPtr> sections;
     bool read(QIODevice &src, QDataStream &ds, QExeErrorInfo *errinfo);
     bool write(QIODevice &dst, QDataStream &ds, QExeErrorInfo *errinfo);
+    void writeHeaders(QIODevice &dst, QDataStream &ds);
     bool test(bool justOrderAndOverlap, quint32 *fileSize = nullptr, QExeErrorInfo *errinfo = nullptr);
     void positionSection(QExeSectionPtr newSec, quint32 i, quint32 sectionAlign);
     QExeSectionPtr createSectionInternal(QExeSectionPtr newSec);
+    bool insertSection(quint32 rva, QExeSectionPtr newSec, QExeErrorInfo *errinfo);
+    bool canAddSectionHeader(quint32 limit, QExeErrorInfo *errinfo) const;
 };
 
 #endif // QEXESECTIONMANAGER_H
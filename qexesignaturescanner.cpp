@@ -0,0 +1,264 @@
+#include "qexesignaturescanner.h"
+
+#include <QStringList>
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <cstring>
+
+#include "qexe.h"
+#include "qexeconcurrent_p.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QEXE_SCANNER_SSE2
+#endif
+
+// sections are split into chunks of this size, which are scanned in parallel
+static const quint32 scanChunkSize = 1024 * 1024;
+// past this many distinct anchor bytes, comparing against each of them costs more than a table lookup per byte
+static const int maxVectorAnchors = 8;
+
+// bytes that show up everywhere in x86 code and data, and so make poor anchors
+static bool isCommonByte(uchar b)
+{
+    switch (b) {
+    case 0x00: case 0xFF: case 0xCC: case 0x90: case 0x0F: case 0x24:
+    case 0x44: case 0x48: case 0x4C: case 0x83: case 0x89: case 0x8B:
+    case 0xC3: case 0xE8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// part of a section, matches have to start in [start, end) but may extend up to size
+struct ScanChunk {
+    const char *data;
+    quint32 size;
+    quint32 start;
+    quint32 end;
+    quint32 baseRVA;
+};
+
+static int hexNibble(QChar c)
+{
+    const ushort u = c.unicode();
+    if (u >= '0' && u <= '9')
+        return u - '0';
+    if (u >= 'A' && u <= 'F')
+        return u - 'A' + 10;
+    if (u >= 'a' && u <= 'f')
+        return u - 'a' + 10;
+    return -1;
+}
+
+QExeSignatureScanner::QExeSignatureScanner()
+{
+    m_maxAnchor = 0;
+}
+
+int QExeSignatureScanner::addPattern(const QString &signature)
+{
+    QByteArray bytes, mask;
+    const QStringList tokens = signature.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+    QString token;
+    foreach (token, tokens) {
+        if (token == QLatin1String("?") || token == QLatin1String("??")) {
+            bytes += '\0';
+            mask += '\0';
+            continue;
+        }
+        if (token.size() != 2)
+            return -1;
+        int value = 0, valueMask = 0;
+        for (int i = 0; i < 2; i++) {
+            value <<= 4;
+            valueMask <<= 4;
+            if (token.at(i) == QLatin1Char('?'))
+                continue;
+            int nibble = hexNibble(token.at(i));
+            if (nibble < 0)
+                return -1;
+            value |= nibble;
+            valueMask |= 0xF;
+        }
+        bytes += static_cast<char>(value);
+        mask += static_cast<char>(valueMask);
+    }
+    return addPattern(bytes, mask);
+}
+
+int QExeSignatureScanner::addPattern(const QByteArray &bytes, const QByteArray &mask)
+{
+    if (bytes.isEmpty() || (!mask.isEmpty() && mask.size() != bytes.size()))
+        return -1;
+    Pattern pattern;
+    pattern.mask = mask.isEmpty() ? QByteArray(bytes.size(), '\xFF') : mask;
+    pattern.bytes = bytes;
+    pattern.exact = true;
+    pattern.anchor = -1;
+    int bestScore = 0;
+    for (int i = 0; i < bytes.size(); i++) {
+        const uchar m = static_cast<uchar>(pattern.mask[i]);
+        pattern.bytes[i] = static_cast<char>(bytes[i] & m);
+        if (m != 0xFF) {
+            pattern.exact = false;
+            continue;
+        }
+        // prefer rare bytes, then bytes other patterns are anchored on already (fewer anchors scan faster)
+        const uchar b = static_cast<uchar>(bytes[i]);
+        int score = (isCommonByte(b) ? 2 : 0) + (m_anchors.contains(static_cast<char>(b)) ? 0 : 1);
+        if (pattern.anchor < 0 || score < bestScore) {
+            pattern.anchor = i;
+            bestScore = score;
+        }
+    }
+    if (pattern.anchor < 0)
+        return -1;
+    const uchar anchorByte = static_cast<uchar>(pattern.bytes[pattern.anchor]);
+    if (m_byAnchor[anchorByte].isEmpty())
+        m_anchors += static_cast<char>(anchorByte);
+    m_byAnchor[anchorByte] += m_patterns.size();
+    m_maxAnchor = qMax(m_maxAnchor, pattern.anchor);
+    m_patterns += pattern;
+    return m_patterns.size() - 1;
+}
+
+int QExeSignatureScanner::patternCount() const
+{
+    return m_patterns.size();
+}
+
+void QExeSignatureScanner::clear()
+{
+    m_patterns.clear();
+    for (int i = 0; i < 256; i++)
+        m_byAnchor[i].clear();
+    m_anchors.clear();
+    m_maxAnchor = 0;
+}
+
+QVector<QExeSignatureScanner::Match> QExeSignatureScanner::scan(const QExe &exeDat) const
+{
+    QSharedPointer<QExeSectionManager> secMgr = exeDat.sectionManager();
+    QVector<QExeSectionPtr> sections;
+    for (int i = 0; i < secMgr->sectionCount(); i++) {
+        QExeSectionPtr section = secMgr->sectionAt(i);
+        if (section->characteristics & (QExeSection::ContainsCode | QExeSection::IsExecutable))
+            sections += section;
+    }
+    return scan(sections);
+}
+
+QVector<QExeSignatureScanner::Match> QExeSignatureScanner::scan(const QVector<QExeSectionPtr> &sections) const
+{
+    QVector<ScanChunk> chunks;
+    quint64 total = 0;
+    QExeSectionPtr section;
+    foreach (section, sections) {
+        // padding past the virtual size isn't loaded
+        quint32 size = static_cast<quint32>(section->rawData.size());
+        if (section->virtualSize != 0)
+            size = qMin(size, section->virtualSize);
+        for (quint32 start = 0; start < size; start += qMin(scanChunkSize, size - start)) {
+            ScanChunk chunk = { section->rawData.constData(), size, start, start + qMin(scanChunkSize, size - start), section->virtualAddr };
+            chunks += chunk;
+        }
+        total += size;
+    }
+    QVector<QVector<Match>> results(chunks.size());
+    QExeConcurrent::forEachIndex(chunks.size(), total > scanChunkSize, [this, &chunks, &results](int i) {
+        const ScanChunk &chunk = chunks[i];
+        scanRange(chunk.data, chunk.size, chunk.start, chunk.end, chunk.baseRVA, &results[i]);
+    });
+    QVector<Match> ret;
+    foreach (const QVector<Match> &result, results)
+        ret += result;
+    std::sort(ret.begin(), ret.end(), [](const Match &match1, const Match &match2) {
+        return match1.rva != match2.rva ? match1.rva < match2.rva : match1.pattern < match2.pattern;
+    });
+    return ret;
+}
+
+QVector<QExeSignatureScanner::Match> QExeSignatureScanner::scan(const char *data, quint32 size, quint32 baseRVA) const
+{
+    QVector<Match> ret;
+    scanRange(data, size, 0, size, baseRVA, &ret);
+    std::sort(ret.begin(), ret.end(), [](const Match &match1, const Match &match2) {
+        return match1.rva != match2.rva ? match1.rva < match2.rva : match1.pattern < match2.pattern;
+    });
+    return ret;
+}
+
+void QExeSignatureScanner::scanRange(const char *data, quint32 size, quint32 start, quint32 end, quint32 baseRVA, QVector<Match> *out) const
+{
+    if (m_patterns.isEmpty())
+        return;
+    // anchors of matches starting in [start, end) are in [start, end + m_maxAnchor)
+    const quint32 to = static_cast<quint32>(qMin<quint64>(size, static_cast<quint64>(end) + m_maxAnchor));
+    quint32 pos = start;
+    const int anchorCount = m_anchors.size();
+    if (anchorCount == 1) {
+        // libc's memchr is vectorized already
+        const char anchor = m_anchors[0];
+        while (pos < to) {
+            const char *hit = static_cast<const char *>(memchr(data + pos, anchor, to - pos));
+            if (hit == nullptr)
+                return;
+            pos = static_cast<quint32>(hit - data);
+            verify(data, size, pos++, start, end, baseRVA, out);
+        }
+        return;
+    }
+#ifdef QEXE_SCANNER_SSE2
+    if (anchorCount <= maxVectorAnchors) {
+        __m128i needles[maxVectorAnchors];
+        for (int i = 0; i < anchorCount; i++)
+            needles[i] = _mm_set1_epi8(m_anchors[i]);
+        for (; to - pos >= 16; pos += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+            __m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+            for (int i = 1; i < anchorCount; i++)
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[i]));
+            uint bits = static_cast<uint>(_mm_movemask_epi8(hits));
+            while (bits != 0) {
+                verify(data, size, pos + qCountTrailingZeroBits(bits), start, end, baseRVA, out);
+                bits &= bits - 1;
+            }
+        }
+    }
+#endif
+    for (; pos < to; pos++) {
+        if (!m_byAnchor[static_cast<uchar>(data[pos])].isEmpty())
+            verify(data, size, pos, start, end, baseRVA, out);
+    }
+}
+
+void QExeSignatureScanner::verify(const char *data, quint32 size, quint32 pos, quint32 start, quint32 end, quint32 baseRVA, QVector<Match> *out) const
+{
+    foreach (int index, m_byAnchor[static_cast<uchar>(data[pos])]) {
+        const Pattern &pattern = m_patterns[index];
+        const quint32 anchor = static_cast<quint32>(pattern.anchor);
+        if (pos < anchor)
+            continue;
+        const quint32 matchPos = pos - anchor;
+        if (matchPos < start || matchPos >= end || static_cast<quint64>(matchPos) + pattern.bytes.size() > size)
+            continue;
+        const char *src = data + matchPos;
+        bool ok;
+        if (pattern.exact)
+            ok = memcmp(src, pattern.bytes.constData(), static_cast<size_t>(pattern.bytes.size())) == 0;
+        else {
+            ok = true;
+            const char *bytes = pattern.bytes.constData();
+            const char *mask = pattern.mask.constData();
+            for (int i = 0; i < pattern.bytes.size() && ok; i++)
+                ok = (src[i] & mask[i]) == bytes[i];
+        }
+        if (ok) {
+            Match match = { index, baseRVA + matchPos };
+            *out += match;
+        }
+    }
+}
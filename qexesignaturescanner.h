@@ -0,0 +1,55 @@
+#ifndef QEXESIGNATURESCANNER_H
+#define QEXESIGNATURESCANNER_H
+
+#include "QExe_global.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "qexesection.h"
+
+class QExe;
+
+// finds byte signatures (with wildcards) in section data
+// every pattern is anchored on one of its fixed bytes: candidates are found by looking for the anchor bytes only
+// (16 bytes at a time where SSE2 is available), then the whole pattern is checked
+class QEXE_EXPORT QExeSignatureScanner
+{
+public:
+    struct Match {
+        int pattern; // as returned by addPattern
+        quint32 rva; // or offset, when scanning a plain buffer
+    };
+
+    QExeSignatureScanner();
+    // "48 8B 05 ?? ?? ?? ??": "?" or "??" matches any byte, "4?"/"?B" only match one nibble
+    // returns the pattern's index, or -1 if the signature is malformed or has no fixed byte
+    int addPattern(const QString &signature);
+    // only bits set in mask have to match, an empty mask matches every byte exactly
+    int addPattern(const QByteArray &bytes, const QByteArray &mask = QByteArray());
+    int patternCount() const;
+    void clear();
+
+    // scans every section containing code, matches are sorted by RVA
+    QVector<Match> scan(const QExe &exeDat) const;
+    QVector<Match> scan(const QVector<QExeSectionPtr> &sections) const;
+    QVector<Match> scan(const char *data, quint32 size, quint32 baseRVA = 0) const;
+private:
+    struct Pattern {
+        QByteArray bytes; // already masked
+        QByteArray mask;
+        int anchor; // offset of the byte candidates are searched for
+        bool exact; // no wildcards, so a memcmp will do
+    };
+    QVector<Pattern> m_patterns;
+    QVector<int> m_byAnchor[256]; // anchor byte => patterns
+    QByteArray m_anchors; // distinct anchor bytes
+    int m_maxAnchor;
+
+    // finds matches starting in [start, end), which may extend up to size
+    void scanRange(const char *data, quint32 size, quint32 start, quint32 end, quint32 baseRVA, QVector<Match> *out) const;
+    void verify(const char *data, quint32 size, quint32 pos, quint32 start, quint32 end, quint32 baseRVA, QVector<Match> *out) const;
+};
+
+#endif // QEXESIGNATURESCANNER_H
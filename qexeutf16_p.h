@@ -0,0 +1,52 @@
+#ifndef QEXEUTF16_P_H
+#define QEXEUTF16_P_H
+
+#include <QString>
+#include <QIODevice>
+#include <QtEndian>
+#include <QVarLengthArray>
+
+// UTF-16LE <-> QString conversion without going through QTextCodec
+// on little-endian hosts QChar already has the right layout, so this is a straight copy
+namespace QExeUtf16 {
+
+// len is in UTF-16 code units, not bytes
+inline QString fromLE(const char *src, int len)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return QString(reinterpret_cast<const QChar *>(src), len);
+#else
+    QString ret(len, Qt::Uninitialized);
+    QChar *dst = ret.data();
+    for (int i = 0; i < len; i++)
+        dst[i] = QChar(qFromLittleEndian<quint16>(src + i * 2));
+    return ret;
+#endif
+}
+
+// dst must have room for str.size() * 2 bytes
+inline void toLE(const QString &str, char *dst)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    memcpy(dst, str.constData(), static_cast<size_t>(str.size()) * 2);
+#else
+    const QChar *src = str.constData();
+    for (int i = 0; i < str.size(); i++)
+        qToLittleEndian<quint16>(src[i].unicode(), dst + i * 2);
+#endif
+}
+
+inline qint64 writeLE(QIODevice &dst, const QString &str)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return dst.write(reinterpret_cast<const char *>(str.constData()), static_cast<qint64>(str.size()) * 2);
+#else
+    QVarLengthArray<char, 512> buf(str.size() * 2);
+    toLE(str, buf.data());
+    return dst.write(buf.constData(), buf.size());
+#endif
+}
+
+}
+
+#endif // QEXEUTF16_P_H
@@ -0,0 +1,131 @@
+#include "qexevirtualimage.h"
+
+#include <QFile>
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#define QEXE_VIRTUALIMAGE_MMAP
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+QExeVirtualImage::QExeVirtualImage()
+{
+    m_data = nullptr;
+    m_size = 0;
+    m_anonymous = false;
+    m_fileMappedSections = 0;
+}
+
+QExeVirtualImage::~QExeVirtualImage()
+{
+    if (m_data == nullptr)
+        return;
+    if (!m_anonymous) {
+        free(m_data);
+        return;
+    }
+#if defined(QEXE_VIRTUALIMAGE_MMAP)
+    // also takes out the file mappings placed inside the range
+    munmap(m_data, m_size);
+#elif defined(Q_OS_WIN)
+    VirtualFree(m_data, 0, MEM_RELEASE);
+#endif
+}
+
+quint32 QExeVirtualImage::size() const
+{
+    return m_size;
+}
+
+char *QExeVirtualImage::data()
+{
+    return m_data;
+}
+
+const char *QExeVirtualImage::constData() const
+{
+    return m_data;
+}
+
+char *QExeVirtualImage::pointer(quint32 rva, quint32 size)
+{
+    if (static_cast<quint64>(rva) + size > m_size)
+        return nullptr;
+    return m_data + rva;
+}
+
+const char *QExeVirtualImage::pointer(quint32 rva, quint32 size) const
+{
+    if (static_cast<quint64>(rva) + size > m_size)
+        return nullptr;
+    return m_data + rva;
+}
+
+int QExeVirtualImage::fileMappedSections() const
+{
+    return m_fileMappedSections;
+}
+
+bool QExeVirtualImage::allocate(quint32 size)
+{
+    m_size = size;
+    if (size == 0)
+        return true;
+    // anonymous memory is zero-filled on first touch, so gaps and uninitialized data cost nothing
+#if defined(QEXE_VIRTUALIMAGE_MMAP)
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED) {
+        m_data = static_cast<char *>(data);
+        m_anonymous = true;
+        return true;
+    }
+#elif defined(Q_OS_WIN)
+    m_data = static_cast<char *>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (m_data != nullptr) {
+        m_anonymous = true;
+        return true;
+    }
+#endif
+    m_data = static_cast<char *>(calloc(size, 1));
+    return m_data != nullptr;
+}
+
+bool QExeVirtualImage::mapFile(QFile &file, qint64 filePos, quint32 rva, quint32 len)
+{
+#if defined(QEXE_VIRTUALIMAGE_MMAP)
+    static const quint32 pageSize = static_cast<quint32>(sysconf(_SC_PAGESIZE));
+    if (!m_anonymous || file.handle() < 0 || rva % pageSize != 0 || filePos % pageSize != 0
+            || static_cast<quint64>(rva) + len > m_size || filePos + len > file.size())
+        return false;
+    // only whole pages can be mapped, and the file holds whatever comes next after the last one,
+    // so the partial last page is copied instead
+    const quint32 mapLen = len - len % pageSize;
+    if (mapLen == 0)
+        return false;
+    void *dst = mmap(m_data + rva, mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file.handle(), static_cast<off_t>(filePos));
+    bool ok = dst != MAP_FAILED;
+    if (ok && mapLen < len) {
+        file.seek(filePos + mapLen);
+        ok = file.read(m_data + rva + mapLen, len - mapLen) == static_cast<qint64>(len - mapLen);
+    }
+    if (!ok) {
+        // a failed fixed mapping may have unmapped the range, so put anonymous pages back; the caller copies instead
+        mmap(m_data + rva, mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        return false;
+    }
+    m_fileMappedSections++;
+    return true;
+#else
+    // mapping a view at a fixed address inside an existing allocation isn't generally available
+    (void)file;
+    (void)filePos;
+    (void)rva;
+    (void)len;
+    return false;
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef QEXEVIRTUALIMAGE_H
+#define QEXEVIRTUALIMAGE_H
+
+#include "QExe_global.h"
+
+#include <QString>
+#include <QtEndian>
+
+class QFile;
+class QExe;
+
+// the image as the loader would lay it out: headers at RVA 0, each section's data at its RVA, zeroes everywhere else
+// backed by anonymous memory, so pages nothing was copied to cost nothing
+// sections that haven't changed since they were read are mapped straight from the source file (copy-on-write) where
+// the platform and alignment allow it
+// the buffer is a snapshot, changes to it don't affect the QExe (and vice versa)
+class QEXE_EXPORT QExeVirtualImage
+{
+public:
+    ~QExeVirtualImage();
+    quint32 size() const;
+    char *data();
+    const char *constData() const;
+    // returns nullptr unless [rva, rva + size) is inside the image
+    char *pointer(quint32 rva, quint32 size = 1);
+    const char *pointer(quint32 rva, quint32 size = 1) const;
+    template<typename T>
+    bool read(quint32 rva, T *value) const {
+        const char *src = pointer(rva, sizeof(T));
+        if (src == nullptr)
+            return false;
+        *value = qFromLittleEndian<T>(src);
+        return true;
+    }
+    // number of sections that are mapped from the source file instead of copied
+    int fileMappedSections() const;
+private:
+    friend class QExe;
+
+    QExeVirtualImage();
+    Q_DISABLE_COPY(QExeVirtualImage)
+    bool allocate(quint32 size);
+    // maps len bytes of file at filePos to rva, returns false if that can't be done (the caller copies instead)
+    bool mapFile(QFile &file, qint64 filePos, quint32 rva, quint32 len);
+    char *m_data;
+    quint32 m_size;
+    bool m_anonymous; // false if m_data came from the heap
+    int m_fileMappedSections;
+};
+
+#endif // QEXEVIRTUALIMAGE_H